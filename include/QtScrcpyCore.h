@@ -1,8 +1,10 @@
 #pragma once
+#include <functional>
 #include <QPointer>
 #include <QMouseEvent>
 
 #include "QtScrcpyCoreDef.h"
+#include "frameref.h"
 
 namespace qsc {
 
@@ -26,6 +28,18 @@ public:
         Q_UNUSED(linesizeU);
         Q_UNUSED(linesizeV);
     }
+    // 与onFrame同时回调，不需要拷贝数据就可以保存帧或传到其他线程处理
+    // (onFrame的数据指针只在回调期间有效)
+    virtual void onFrameRef(const FrameRef &frame) { Q_UNUSED(frame); }
+    // DeviceParams::thumbnailWidth不为0时回调缩略图(GUI线程)，像素格式见DeviceParams::thumbnailFormat
+    virtual void onThumbnail(const FrameRef &thumbnail) { Q_UNUSED(thumbnail); }
+    // DeviceParams::dirtyTileSize不为0时，画面有变化时回调变化区域(GUI线程)
+    virtual void onDirtyRegion(const DirtyRegion &region) { Q_UNUSED(region); }
+    // 画面持续DeviceParams::screenStableMs没有变化时回调true，之后再有变化时回调false
+    // 只解码关键帧时(CS_HIDDEN、thumbnailKeyFramesOnly)无法确认画面没有变化，回调false且不会回调true，断开连接时回调false
+    virtual void onScreenStable(bool stable) { Q_UNUSED(stable); }
+    // DeviceParams::exportMotion为true时，每个非关键帧回调运动信息(GUI线程)
+    virtual void onMotion(const MotionInfo &motion) { Q_UNUSED(motion); }
     virtual void updateFPS(quint32 fps) { Q_UNUSED(fps); }
     virtual void grabCursor(bool grab) {Q_UNUSED(grab);}
 
@@ -88,6 +102,9 @@ public:
     virtual void setUserData(void* data) = 0;
     virtual void* getUserData() = 0;
     virtual void registerDeviceObserver(DeviceObserver* observer) = 0;
+    // 指定视频帧回调方式，其他回调总是在GUI线程
+    // 在非GUI线程回调的observer不能在onFrame/onFrameRef里注销自己
+    virtual void registerDeviceObserver(DeviceObserver* observer, const ObserverOptions &options) = 0;
     virtual void deRegisterDeviceObserver(DeviceObserver* observer) = 0;
 
     virtual bool connectDevice() = 0;
@@ -117,14 +134,40 @@ public:
     virtual void pushFileRequest(const QString &file, const QString &devicePath = "") = 0;
     virtual void installApkRequest(const QString &apkFile) = 0;
 
+    // 截图保存为PNG到DeviceParams::recordPath，不阻塞GUI线程和解码
     virtual void screenshot() = 0;
+    // 在工作线程转换和编码最近显示的一帧，完成后在GUI线程回调
+    // 还没有画面时回调的result.success为false
+    virtual void screenshot(const ScreenshotOptions &options, std::function<void(const ScreenshotResult &result)> callback) = 0;
     virtual void showTouch(bool show) = 0;
+    // 声明画面的使用状态(焦点/可见/缩略图/隐藏)，降低不需要全速显示的设备的解码开销
+    virtual void setConsumptionState(ConsumptionState state) = 0;
+    virtual ConsumptionState getConsumptionState() = 0;
+    // 画面是否已稳定(需要设置DeviceParams::dirtyTileSize)
+    virtual bool isScreenStable() = 0;
+    // 把回放缓冲中的视频(DeviceParams::replayBufferSeconds)保存为mp4/mkv，在工作线程写文件，完成后在GUI线程回调
+    // filePath为空时保存到DeviceParams::recordPath，格式为DeviceParams::recordFileFormat
+    // 断开连接后仍可保存，缓冲为空时回调的success为false
+    virtual void saveReplayBuffer(const QString &filePath, std::function<void(bool success, const QString &filePath)> callback) = 0;
+    // 连接后开始录制，不需要重新连接设备，从下一个关键帧开始(会请求设备立即发送关键帧)
+    // filePath为空时保存到DeviceParams::recordPath，format为mp4/mkv，为空时按filePath后缀或DeviceParams::recordFileFormat
+    // 录制参数(队列/分段/fragmented/写缓冲)使用DeviceParams，所有设备的录制共用写线程池(IDeviceManage::setRecordWriters)
+    virtual bool startRecording(const QString &filePath = "", const QString &format = "") = 0;
+    // 停止录制，剩余的包在写线程写完后关闭文件，不阻塞GUI线程
+    virtual void stopRecording() = 0;
+    virtual bool isRecording() = 0;
 
     virtual bool isReversePort(quint16 port) = 0;
     virtual const QString &getSerial() = 0;
 
     virtual void updateScript(QString script) = 0;
     virtual bool isCurrentCustomKeymap() = 0;
+
+    // 各阶段延迟统计(p50/p95/p99)，从连接开始或上次reset开始累计
+    virtual PipelineStats getPipelineStats() = 0;
+    // observer的视频帧投递统计
+    virtual ObserverStats getObserverStats(DeviceObserver* observer) = 0;
+    virtual void resetPipelineStats() = 0;
 };
 
 class IDeviceManage : public QObject {
@@ -135,6 +178,14 @@ public:
     virtual bool disconnectDevice(const QString &serial) = 0;
     virtual void disconnectAllDevice() = 0;
     virtual QPointer<IDevice> getDevice(const QString& serial) = 0;
+    // 本机所有设备解码线程总数上限，0不限制，对之后打开的解码器生效
+    virtual void setMaxDecodeThreads(int maxThreads) = 0;
+    // 所有设备共用的解码线程池大小，0:每个设备独立解码线程，需在连接设备之前设置
+    virtual void setSharedDecodeWorkers(int workers) = 0;
+    // 所有设备回放缓冲的内存总上限(MB)，0不限制，已分配的内存不会释放，只限制之后的增长
+    virtual void setReplayBufferBudget(int megabytes) = 0;
+    // 所有设备的录制共用的写线程数(默认2)，需在开始第一个录制之前设置
+    virtual void setRecordWriters(int writers) = 0;
 
 signals:
     void deviceConnected(bool success, const QString& serial, const QString& deviceName, const QSize& size);
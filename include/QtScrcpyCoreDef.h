@@ -1,8 +1,129 @@
 #pragma once
+#include <QByteArray>
+#include <QRect>
 #include <QString>
+#include <QVector>
 
 namespace qsc {
 
+// 软件解码多线程方式
+enum DecodeThreadType {
+    DTT_SLICE = 0, // slice多线程，不增加延迟(需要编码端输出多个slice才有效)
+    DTT_FRAME,     // frame多线程，吞吐高，适合1440p/4K，但每多一个线程增加一帧延迟
+};
+
+// 解码帧缓冲策略(解码线程 -> observer)
+enum FrameBufferPolicy {
+    FBP_LATEST = 0, // 只保留最新一帧，observer来不及处理时丢弃旧帧，延迟最低
+    FBP_FIFO,       // 最多缓存frameBufferDepth帧，按顺序分发，满了丢弃最旧的帧
+    FBP_BLOCK,      // 最多缓存frameBufferDepth帧，满了解码线程等待，不丢帧
+};
+
+// 设备画面的使用状态，解码和分发按状态降级以节省CPU，录制不受影响
+enum ConsumptionState {
+    CS_FOCUSED = 0, // 焦点窗口，全速解码和分发
+    CS_VISIBLE,     // 可见，全速解码，分发帧率不超过DeviceParams::visibleMaxFps
+    CS_THUMBNAIL,   // 小窗/墙视图，跳过去块滤波，分发帧率不超过DeviceParams::thumbnailMaxFps
+    CS_HIDDEN,      // 最小化/不可见，只解码关键帧
+};
+
+// 缩略图像素格式
+enum ThumbnailFormat {
+    TF_RGB32 = 0, // 可直接构造QImage::Format_RGB32
+    TF_NV12,      // 适合GPU纹理上传或再编码
+};
+
+// observer接收视频帧(onFrame/onFrameRef)的线程
+enum ObserverDelivery {
+    OD_GUI_THREAD = 0, // GUI线程(默认)，适合渲染
+    OD_WORKER_THREAD,  // observer独占的工作线程，直接从解码线程投递，不经过GUI线程
+    OD_SHARED_POOL,    // 所有设备共享的线程池，同一个observer的帧按顺序回调
+};
+
+// observer请求的视频帧像素格式
+enum OutputFormat {
+    OF_NATIVE = 0, // 解码器输出格式(YUV420P)
+    OF_YUV420P,
+    OF_NV12,
+    OF_RGBA,
+    OF_GRAY8,
+};
+
+struct ObserverOptions {
+    ObserverDelivery delivery = OD_GUI_THREAD;
+    int mailboxSize = 2; // 非GUI线程投递时每个observer的帧队列长度，满了丢弃最旧的帧
+    // 输出格式和大小，多个observer请求相同输出时只转换一次
+    // 只有YUV420P输出会回调onFrame，其他格式只回调onFrameRef
+    OutputFormat outputFormat = OF_NATIVE;
+    int outputWidth = 0;  // 0:按比例(宽高都为0时为原始大小)
+    int outputHeight = 0;
+};
+
+struct ObserverStats {
+    quint64 delivered = 0; // 已回调的帧数
+    quint64 dropped = 0;   // 因observer处理不及时丢弃的帧数
+    int mailboxDepth = 0;  // 当前队列中等待回调的帧数
+};
+
+// 录制文件同步到磁盘(fsync)的策略
+enum RecordSyncPolicy {
+    RSP_NONE = 0,  // 不主动同步，由系统回写
+    RSP_CLOSE,     // 关闭文件(每段)时同步
+    RSP_PERIODIC,  // 每recordSyncSeconds秒和关闭文件时同步，配合recordFragmented断电时最多丢失这段时间的录像
+};
+
+// 截图编码格式
+enum ScreenshotFormat {
+    SF_PNG = 0,
+    SF_JPEG,
+    SF_RAW_RGB32, // 不编码，width*4字节一行的QImage::Format_RGB32数据
+};
+
+struct ScreenshotOptions {
+    ScreenshotFormat format = SF_PNG;
+    int quality = -1;        // 编码质量0~100，-1为默认(PNG为压缩级别，越小压缩越少越快)
+    bool saveToFile = false; // 同时保存到DeviceParams::recordPath
+};
+
+struct ScreenshotResult {
+    bool success = false;
+    ScreenshotFormat format = SF_PNG;
+    int width = 0;
+    int height = 0;
+    qint64 pts = 0;     // 截取帧的pts(微秒)
+    QByteArray data;    // 编码后的数据
+    QString filePath;   // saveToFile时保存的文件路径
+};
+
+// 相邻两帧之间有变化的区域，画面按tileSize划分为columns*rows的网格
+struct DirtyRegion {
+    qint64 pts = 0;       // 帧的pts(微秒)
+    int width = 0;        // 帧大小
+    int height = 0;
+    int tileSize = 0;
+    int columns = 0;
+    int rows = 0;
+    QByteArray tiles;     // columns*rows字节，按行排列，非0表示该块有变化
+    int dirtyTiles = 0;   // 有变化的块数
+    QRect bounds;         // 所有变化块的外接矩形(像素)
+};
+
+// 一帧的运动信息，来自解码器导出的H.264运动矢量，不比较像素
+// 画面按cellSize划分为columns*rows的网格
+struct MotionInfo {
+    qint64 pts = 0;        // 帧的pts(微秒)
+    int width = 0;         // 帧大小
+    int height = 0;
+    int cellSize = 0;
+    int columns = 0;
+    int rows = 0;
+    QVector<float> cells;  // columns*rows，按行排列，每格的平均运动幅度(像素)
+    float activity = 0;    // 变化面积比例0~1(运动的块和帧内编码的块)，0表示画面静止
+    float intraRatio = 0;  // 帧内编码(没有运动矢量)的面积比例，新内容出现时较大
+    float dx = 0;          // 运动块内容的平均位移(像素/帧)，滚动时接近滚动速度和方向
+    float dy = 0;
+};
+
 struct DeviceParams {
     // necessary
     QString serial = "";              // 设备序列号
@@ -24,21 +145,115 @@ struct DeviceParams {
     // 例如 CodecOptions="profile=1,level=2"
     // 更多编码选项参考 https://d.android.com/reference/android/media/MediaFormat
     QString codecOptions = "";
-    // 指定编码器名称(必须是H.264编码器)，""表示默认
+    // 指定编码器名称(必须与videoCodec一致)，""表示默认
     // 例如 CodecName="OMX.qcom.video.encoder.avc"
     QString codecName = "";
+    // 视频编码格式 h264/h265/av1，h265相同画质下码率约为h264的一半
+    // 本地解码器不支持时自动回退到h264
+    QString videoCodec = "h264";
     quint32 scid = -1; // 随机数，作为localsocket名字后缀，方便同时连接同一个设备多次
 
     QString recordPath = "";          // 视频保存路径
     QString recordFileFormat = "mp4"; // 视频保存格式 mp4/mkv
-    bool recordFile = false;          // 录制到文件
+    bool recordFile = false;          // 连接后立即录制到文件，也可以通过IDevice::startRecording随时开始
+    int recordQueueSize = 256;        // 收包线程与录制线程之间的包队列长度
+    bool recordFragmented = false;    // mp4使用fragmented MP4，录制中崩溃或断电文件仍可播放，停止时不需要重写文件
+    // 分段录制：达到时长或大小后在下一个关键帧切换到新文件(文件名后加_001,_002...)
+    quint32 recordSegmentSeconds = 0; // 每段最长时长(秒)，0不限制
+    quint32 recordSegmentMB = 0;      // 每段最大大小(MB)，0不限制
+    bool recordQueueDropUntilKeyFrame = true; // 录制队列满时 true:丢包直到下一个关键帧(录像跳帧) false:收包线程等待(画面卡顿)
+    quint32 recordWriteBufferKB = 1024; // 写文件缓冲大小(KB)，缓冲满时才写文件，减少小块写
+    RecordSyncPolicy recordSyncPolicy = RSP_CLOSE;
+    quint32 recordSyncSeconds = 5;    // RSP_PERIODIC的同步间隔(秒)
+    // 回放缓冲：在内存中保留最近一段视频包(从关键帧开始)，需要时通过IDevice::saveReplayBuffer保存，不需要一直录制
+    quint32 replayBufferSeconds = 0;  // 保留的时长(秒)，0不保留
+    quint32 replayBufferMB = 32;      // 每个设备的内存上限(MB，最大1024)，超出时丢弃最早的关键帧间隔，受IDeviceManage::setReplayBufferBudget限制
 
     QString pushFilePath = "/sdcard/"; // 推送到安卓设备的文件保存路径（必须以/结尾）
 
     bool closeScreen = false;         // 启动时自动息屏
     bool display = true;              // 是否显示画面（或者仅仅后台录制）
-    bool renderExpiredFrames = false; // 是否渲染延迟视频帧
+    bool renderExpiredFrames = false; // 是否渲染延迟视频帧(true等同于frameBufferPolicy = FBP_BLOCK)
+    FrameBufferPolicy frameBufferPolicy = FBP_LATEST; // 解码帧缓冲策略
+    int frameBufferDepth = 3;         // FBP_FIFO/FBP_BLOCK时缓存的最大帧数
+    bool nativeIngest = false;        // 使用epoll原生socket接收视频流(仅Linux)，所有设备共享固定数量的IO线程，此时解码队列总是丢包直到下一个关键帧
+    int decodeThreads = 1;            // 解码线程数 0:自动(CPU核数) 1:单线程，受IDeviceManage::setMaxDecodeThreads限制
+    DecodeThreadType decodeThreadType = DTT_SLICE; // 解码多线程方式
+    int decodeQueueSize = 16;         // 收包线程与解码线程之间的包队列长度，0表示在收包线程直接解码
+    bool decodeQueueDropUntilKeyFrame = false; // 队列满时 true:丢包直到下一个关键帧 false:收包线程等待
+    int decodePriority = 1;           // 使用共享解码线程池时的权重(每轮解码的包数)，越大分到的解码时间越多
+    quint32 visibleMaxFps = 0;        // CS_VISIBLE时分发给observer的最大帧率，0不限制
+    quint32 thumbnailMaxFps = 5;      // CS_THUMBNAIL时分发给observer的最大帧率，0不限制
+    // 缩略图：缩小后的画面通过DeviceObserver::onThumbnail回调，适合同时监控大量设备
+    int thumbnailWidth = 0;           // 缩略图宽度(高度按比例)，0不输出缩略图
+    ThumbnailFormat thumbnailFormat = TF_RGB32;
+    quint32 thumbnailImageFps = 2;    // 缩略图输出帧率，0不限制
+    bool thumbnailOnly = false;       // 只输出缩略图不回调onFrame，解码使用低开销设置(跳过去块滤波,AV_CODEC_FLAG2_FAST)
+    bool thumbnailKeyFramesOnly = false; // thumbnailOnly时只解码关键帧，CPU最低，画面更新间隔取决于设备端关键帧间隔
+    // 画面变化检测：比较相邻帧的亮度，通过DeviceObserver::onDirtyRegion/onScreenStable回调
+    int dirtyTileSize = 0;            // 检测块大小(像素)，如32，0不检测
+    int dirtyThreshold = 1;           // 块内平均每像素亮度差超过该值才算变化，0表示任何变化
+    quint32 screenStableMs = 500;     // 画面持续该时间没有变化时回调onScreenStable(true)
+    // 运动信息：解码器导出运动矢量，通过DeviceObserver::onMotion回调，适合低开销检测滚动/动画/卡死，只支持h264
+    bool exportMotion = false;
+    int motionCellSize = 64;          // 运动网格的格子大小(像素)
     QString gameScript = "";          // 游戏映射脚本
+
+    // 抓包/回放：用于无设备复现问题和在CI上测试解码录制性能
+    QString captureFile = "";         // 非空时把视频socket原始数据(含设备信息和时间戳)保存到该文件
+    QString replayFile = "";          // 非空时不连接设备，从抓包文件读取视频流
+    bool replayRealtime = true;       // true:按抓包时的节奏回放 false:尽快回放
+};
+
+// 延迟统计，单位毫秒
+struct LatencyStat {
+    quint64 count = 0;
+    double p50 = 0;
+    double p95 = 0;
+    double p99 = 0;
+    double max = 0;
+};
+
+// 包队列统计
+struct PacketQueueStats {
+    int capacity = 0;     // 队列容量，0表示未使用队列
+    int depth = 0;        // 当前队列长度
+    int maxDepth = 0;     // 最大队列长度
+    quint64 pushed = 0;   // 入队包数
+    quint64 dropped = 0;  // 队列满丢弃的包数
+    quint64 blocked = 0;  // 队列满导致入队等待的次数
+    quint64 wakeups = 0;  // 唤醒出队线程的次数
+};
+
+// 回放缓冲统计
+struct ReplayBufferStats {
+    qint64 durationMs = 0; // 缓冲中的视频时长
+    int packets = 0;       // 缓冲中的包数
+    qint64 bytes = 0;      // 缓冲中的数据大小
+    qint64 capacity = 0;   // 已从内存上限中预留的大小
+    quint64 evicted = 0;   // 因内存上限提前丢弃的包数(不为0时缓冲时长可能不足replayBufferSeconds)
+};
+
+// 录制文件写入统计
+struct RecordStats {
+    quint64 bytesWritten = 0; // 写入文件的字节数
+    quint64 writes = 0;       // 写文件次数
+    quint64 syncs = 0;        // 同步到磁盘次数
+};
+
+// 视频流水线各阶段延迟
+struct PipelineStats {
+    LatencyStat recvToDecode;   // 收到数据包 -> 送入解码器
+    LatencyStat decode;         // 送入解码器 -> 解码出帧
+    LatencyStat decodeToOffer;  // 解码出帧 -> 放入帧缓冲
+    LatencyStat offerToDeliver; // 放入帧缓冲 -> 分发给observer
+    LatencyStat total;          // 收到数据包 -> 分发给observer
+    LatencyStat decodeTime;     // 每次解码调用(送包+取帧)耗时，衡量解码开销
+    int decodeThreads = 0;      // 实际使用的解码线程数
+    PacketQueueStats decodeQueue; // 收包线程 -> 解码线程的包队列
+    PacketQueueStats recordQueue; // 收包线程 -> 录制写线程的包队列
+    RecordStats record;           // 当前录制的文件写入
+    ReplayBufferStats replayBuffer;
 };
     
 }
@@ -0,0 +1,53 @@
+#ifndef FRAMEREF_H
+#define FRAMEREF_H
+
+#include <QMetaType>
+#include <QtGlobal>
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+
+namespace qsc {
+
+// 解码帧的引用(零拷贝)
+// 内部持有解码帧数据的引用计数(av_frame_ref)，拷贝只增加引用计数，不拷贝像素数据
+// 可以跨线程传递和保存，最后一个FrameRef析构时释放帧数据，持有期间不会阻塞解码
+class FrameRef
+{
+public:
+    FrameRef();
+    // 引用frame的数据，frame为空或引用失败时isValid()返回false
+    explicit FrameRef(const AVFrame *frame);
+    FrameRef(const FrameRef &other);
+    FrameRef(FrameRef &&other);
+    ~FrameRef();
+
+    FrameRef &operator=(const FrameRef &other);
+    FrameRef &operator=(FrameRef &&other);
+
+    bool isValid() const;
+    // 释放引用
+    void reset();
+
+    int width() const;
+    int height() const;
+    // 设备端采集时间戳(微秒)
+    qint64 pts() const;
+    // 像素格式，AVPixelFormat的值：observer在ObserverOptions中指定的格式，未指定时为解码器输出的格式
+    int format() const;
+    // YUV420P的plane 0:Y 1:U 2:V，NV12为Y和UV，RGBA/RGB32/GRAY8只有plane 0
+    const uint8_t *data(int plane) const;
+    int linesize(int plane) const;
+
+    // 给直接使用FFmpeg的调用者，生命周期与FrameRef相同
+    const AVFrame *avFrame() const;
+
+private:
+    AVFrame *m_frame = Q_NULLPTR;
+};
+
+}
+
+Q_DECLARE_METATYPE(qsc::FrameRef)
+
+#endif // FRAMEREF_H
@@ -0,0 +1,110 @@
+#include "frameref.h"
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+namespace qsc {
+
+FrameRef::FrameRef() {}
+
+FrameRef::FrameRef(const AVFrame *frame)
+{
+    if (!frame) {
+        return;
+    }
+    m_frame = av_frame_alloc();
+    if (!m_frame) {
+        return;
+    }
+    if (av_frame_ref(m_frame, frame) < 0) {
+        av_frame_free(&m_frame);
+    }
+}
+
+FrameRef::FrameRef(const FrameRef &other) : FrameRef(other.m_frame) {}
+
+FrameRef::FrameRef(FrameRef &&other) : m_frame(other.m_frame)
+{
+    other.m_frame = Q_NULLPTR;
+}
+
+FrameRef::~FrameRef()
+{
+    reset();
+}
+
+FrameRef &FrameRef::operator=(const FrameRef &other)
+{
+    if (this != &other) {
+        FrameRef tmp(other);
+        qSwap(m_frame, tmp.m_frame);
+    }
+    return *this;
+}
+
+FrameRef &FrameRef::operator=(FrameRef &&other)
+{
+    if (this != &other) {
+        reset();
+        m_frame = other.m_frame;
+        other.m_frame = Q_NULLPTR;
+    }
+    return *this;
+}
+
+bool FrameRef::isValid() const
+{
+    return m_frame != Q_NULLPTR;
+}
+
+void FrameRef::reset()
+{
+    if (m_frame) {
+        av_frame_free(&m_frame);
+    }
+}
+
+int FrameRef::width() const
+{
+    return m_frame ? m_frame->width : 0;
+}
+
+int FrameRef::height() const
+{
+    return m_frame ? m_frame->height : 0;
+}
+
+qint64 FrameRef::pts() const
+{
+    return m_frame ? m_frame->pts : 0;
+}
+
+int FrameRef::format() const
+{
+    return m_frame ? m_frame->format : -1;
+}
+
+const uint8_t *FrameRef::data(int plane) const
+{
+    if (!m_frame || plane < 0 || plane >= AV_NUM_DATA_POINTERS) {
+        return Q_NULLPTR;
+    }
+    return m_frame->data[plane];
+}
+
+int FrameRef::linesize(int plane) const
+{
+    if (!m_frame || plane < 0 || plane >= AV_NUM_DATA_POINTERS) {
+        return 0;
+    }
+    return m_frame->linesize[plane];
+}
+
+const AVFrame *FrameRef::avFrame() const
+{
+    return m_frame;
+}
+
+}
@@ -0,0 +1,195 @@
+#include <cstring>
+
+#include <QMutexLocker>
+#include <QtAlgorithms>
+
+#include "latencytracker.h"
+
+extern "C"
+{
+#include "libavutil/avutil.h"
+#include "libavutil/time.h"
+}
+
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_MSB 33
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::add(qint64 us)
+{
+    if (us < 0) {
+        us = 0;
+    }
+    m_buckets[bucketIndex(static_cast<quint64>(us))]++;
+    m_count++;
+    m_max = qMax(m_max, us);
+}
+
+void LatencyHistogram::reset()
+{
+    memset(m_buckets, 0, sizeof(m_buckets));
+    m_count = 0;
+    m_max = 0;
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return m_count;
+}
+
+qint64 LatencyHistogram::percentile(double p) const
+{
+    if (!m_count) {
+        return 0;
+    }
+    quint64 rank = static_cast<quint64>(p * m_count / 100.0);
+    if (rank >= m_count) {
+        rank = m_count - 1;
+    }
+    quint64 seen = 0;
+    for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+        seen += m_buckets[i];
+        if (seen > rank) {
+            return qMin(bucketValue(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+qsc::LatencyStat LatencyHistogram::stat() const
+{
+    qsc::LatencyStat stat;
+    stat.count = m_count;
+    stat.p50 = percentile(50) / 1000.0;
+    stat.p95 = percentile(95) / 1000.0;
+    stat.p99 = percentile(99) / 1000.0;
+    stat.max = m_max / 1000.0;
+    return stat;
+}
+
+int LatencyHistogram::bucketIndex(quint64 us)
+{
+    if (us < LATENCY_SUB_BUCKETS) {
+        return static_cast<int>(us);
+    }
+    int msb = 63 - static_cast<int>(qCountLeadingZeroBits(us));
+    if (msb > LATENCY_MAX_MSB) {
+        return LATENCY_HISTOGRAM_BUCKETS - 1;
+    }
+    int sub = static_cast<int>((us >> (msb - LATENCY_SUB_BUCKET_BITS)) & (LATENCY_SUB_BUCKETS - 1));
+    return (msb - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS + sub;
+}
+
+qint64 LatencyHistogram::bucketValue(int index)
+{
+    if (index < LATENCY_SUB_BUCKETS) {
+        return index;
+    }
+    int msb = index / LATENCY_SUB_BUCKETS + LATENCY_SUB_BUCKET_BITS - 1;
+    int sub = index % LATENCY_SUB_BUCKETS;
+    int shift = msb - LATENCY_SUB_BUCKET_BITS;
+    qint64 lower = static_cast<qint64>(LATENCY_SUB_BUCKETS + sub) << shift;
+    // middle of the bucket
+    return lower + ((Q_INT64_C(1) << shift) >> 1);
+}
+
+LatencyTracker::LatencyTracker()
+{
+    for (int i = 0; i < ENTRY_COUNT; i++) {
+        m_entries[i].pts = AV_NOPTS_VALUE;
+    }
+}
+
+qint64 LatencyTracker::now()
+{
+    return av_gettime_relative();
+}
+
+void LatencyTracker::mark(LatencyTracker::Stage stage, qint64 pts)
+{
+    if (AV_NOPTS_VALUE == pts) {
+        // config packets are merged into the next packet
+        return;
+    }
+    qint64 time = now();
+
+    QMutexLocker locker(&m_mutex);
+    if (STAGE_RECV == stage) {
+        Entry &entry = m_entries[m_next];
+        m_next = (m_next + 1) % ENTRY_COUNT;
+        entry.pts = pts;
+        for (int i = 0; i < STAGE_COUNT; i++) {
+            entry.times[i] = -1;
+        }
+        entry.times[STAGE_RECV] = time;
+        return;
+    }
+
+    // the packet is almost always one of the latest
+    for (int i = 1; i <= ENTRY_COUNT; i++) {
+        Entry &entry = m_entries[(m_next - i + ENTRY_COUNT) % ENTRY_COUNT];
+        if (entry.pts != pts) {
+            continue;
+        }
+        entry.times[stage] = time;
+        if (STAGE_DELIVER == stage) {
+            collect(entry.times);
+            entry.pts = AV_NOPTS_VALUE;
+        }
+        return;
+    }
+}
+
+void LatencyTracker::addDecodeTime(qint64 us)
+{
+    QMutexLocker locker(&m_mutex);
+    m_decodeTime.add(us);
+}
+
+qsc::PipelineStats LatencyTracker::stats()
+{
+    QMutexLocker locker(&m_mutex);
+    qsc::PipelineStats stats;
+    stats.recvToDecode = m_recvToDecode.stat();
+    stats.decode = m_decode.stat();
+    stats.decodeToOffer = m_decodeToOffer.stat();
+    stats.offerToDeliver = m_offerToDeliver.stat();
+    stats.total = m_total.stat();
+    stats.decodeTime = m_decodeTime.stat();
+    return stats;
+}
+
+void LatencyTracker::reset()
+{
+    QMutexLocker locker(&m_mutex);
+    m_recvToDecode.reset();
+    m_decode.reset();
+    m_decodeToOffer.reset();
+    m_offerToDeliver.reset();
+    m_total.reset();
+    m_decodeTime.reset();
+}
+
+void LatencyTracker::collect(const qint64 *times)
+{
+    if (times[STAGE_RECV] >= 0 && times[STAGE_DECODE_SEND] >= 0) {
+        m_recvToDecode.add(times[STAGE_DECODE_SEND] - times[STAGE_RECV]);
+    }
+    if (times[STAGE_DECODE_SEND] >= 0 && times[STAGE_DECODE_RECEIVE] >= 0) {
+        m_decode.add(times[STAGE_DECODE_RECEIVE] - times[STAGE_DECODE_SEND]);
+    }
+    if (times[STAGE_DECODE_RECEIVE] >= 0 && times[STAGE_OFFER] >= 0) {
+        m_decodeToOffer.add(times[STAGE_OFFER] - times[STAGE_DECODE_RECEIVE]);
+    }
+    if (times[STAGE_OFFER] >= 0 && times[STAGE_DELIVER] >= 0) {
+        m_offerToDeliver.add(times[STAGE_DELIVER] - times[STAGE_OFFER]);
+    }
+    if (times[STAGE_RECV] >= 0 && times[STAGE_DELIVER] >= 0) {
+        m_total.add(times[STAGE_DELIVER] - times[STAGE_RECV]);
+    }
+}
@@ -0,0 +1,85 @@
+#ifndef LATENCYTRACKER_H
+#define LATENCYTRACKER_H
+
+#include <QMutex>
+
+#include "../../include/QtScrcpyCoreDef.h"
+
+// values up to 2^34 us (~4.7 hours), 16 sub buckets per power of two
+#define LATENCY_HISTOGRAM_BUCKETS 496
+
+// Log-linear latency histogram in microseconds, relative error below 1/32.
+// Not thread safe.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void add(qint64 us);
+    void reset();
+    quint64 count() const;
+    qint64 percentile(double p) const;
+    qsc::LatencyStat stat() const;
+
+private:
+    static int bucketIndex(quint64 us);
+    static qint64 bucketValue(int index);
+
+private:
+    quint32 m_buckets[LATENCY_HISTOGRAM_BUCKETS];
+    quint64 m_count = 0;
+    qint64 m_max = 0;
+};
+
+// Stamps every packet with a monotonic host time at each pipeline stage,
+// keyed by pts, and collects the per stage latencies once a frame is delivered.
+// Thread safe: the stages run on the demuxer, decoder and gui threads.
+class LatencyTracker
+{
+public:
+    enum Stage
+    {
+        STAGE_RECV = 0,       // Demuxer::recvPacket
+        STAGE_DECODE_SEND,    // Decoder::push, packet sent to the decoder
+        STAGE_DECODE_RECEIVE, // Decoder::push, frame received from the decoder
+        STAGE_OFFER,          // VideoBuffer::offerDecodedFrame
+        STAGE_DELIVER,        // Decoder::onNewFrame
+        STAGE_COUNT,
+    };
+
+    LatencyTracker();
+
+    // monotonic host time in microseconds
+    static qint64 now();
+
+    void mark(Stage stage, qint64 pts);
+    // duration of one decoder call, independent of the frame it outputs
+    void addDecodeTime(qint64 us);
+    qsc::PipelineStats stats();
+    void reset();
+
+private:
+    void collect(const qint64 *times);
+
+private:
+    // packets in flight are few, older entries are simply overwritten
+    struct Entry
+    {
+        qint64 pts;
+        qint64 times[STAGE_COUNT];
+    };
+    static const int ENTRY_COUNT = 64;
+
+    QMutex m_mutex;
+    Entry m_entries[ENTRY_COUNT];
+    int m_next = 0;
+
+    LatencyHistogram m_recvToDecode;
+    LatencyHistogram m_decode;
+    LatencyHistogram m_decodeToOffer;
+    LatencyHistogram m_offerToDeliver;
+    LatencyHistogram m_total;
+    LatencyHistogram m_decodeTime;
+};
+
+#endif // LATENCYTRACKER_H
@@ -0,0 +1,219 @@
+#include <QMutexLocker>
+#include <QThread>
+
+#include "packetqueue.h"
+
+PacketQueue::PacketQueue(int capacity, OverflowPolicy policy)
+    : m_policy(policy), m_head(0), m_tail(0), m_interrupted(false), m_finished(false), m_consumerParked(false), m_producerParked(false),
+      m_pushed(0), m_dropped(0), m_blocked(0), m_wakeups(0), m_maxDepth(0)
+{
+    quint32 size = 2;
+    while (size < static_cast<quint32>(capacity)) {
+        size <<= 1;
+    }
+    m_mask = size - 1;
+    m_slots = new AVPacket *[size];
+    for (quint32 i = 0; i < size; i++) {
+        m_slots[i] = av_packet_alloc();
+    }
+}
+
+PacketQueue::~PacketQueue()
+{
+    clear();
+    for (quint32 i = 0; i <= m_mask; i++) {
+        av_packet_free(&m_slots[i]);
+    }
+    delete[] m_slots;
+}
+
+void PacketQueue::setWakeupBatch(int batch, int maxDelayMs)
+{
+    // a full queue must always wake the consumer
+    m_wakeupBatch = qBound(1, batch, static_cast<int>(m_mask + 1));
+    m_maxDelayMs = qMax(0, maxDelayMs);
+}
+
+void PacketQueue::setSpin(int spin)
+{
+    m_spin = qMax(0, spin);
+}
+
+bool PacketQueue::push(const AVPacket *packet)
+{
+    if (m_interrupted.load()) {
+        return false;
+    }
+
+    // config packets (no pts) are needed as much as key frames
+    bool keyFrame = (packet->flags & AV_PKT_FLAG_KEY) || AV_NOPTS_VALUE == packet->pts;
+    if (m_dropping && !keyFrame) {
+        // the decoder cannot use it without the dropped references
+        m_dropped++;
+        return false;
+    }
+
+    quint32 tail = m_tail.load(std::memory_order_relaxed);
+    bool blocked = false;
+    for (;;) {
+        quint32 head = m_head.load(std::memory_order_acquire);
+        if (tail - head <= m_mask) {
+            break;
+        }
+        if (OVERFLOW_DROP_UNTIL_KEY_FRAME == m_policy) {
+            m_dropping = true;
+            m_dropped++;
+            return false;
+        }
+        if (!blocked) {
+            blocked = true;
+            m_blocked++;
+        }
+        QMutexLocker locker(&m_parkMutex);
+        m_producerParked.store(true);
+        if (m_head.load() == head && !m_interrupted.load()) {
+            m_notFullCond.wait(&m_parkMutex);
+        }
+        m_producerParked.store(false);
+        if (m_interrupted.load()) {
+            return false;
+        }
+    }
+    m_dropping = false;
+
+    if (av_packet_ref(m_slots[tail & m_mask], packet)) {
+        return false;
+    }
+    m_tail.store(tail + 1);
+    m_pushed++;
+
+    quint32 depth = tail + 1 - m_head.load(std::memory_order_relaxed);
+    if (depth > m_maxDepth.load(std::memory_order_relaxed)) {
+        m_maxDepth.store(depth, std::memory_order_relaxed);
+    }
+
+    if (m_consumerParked.load() && (depth >= static_cast<quint32>(m_wakeupBatch) || !m_maxDelayMs)) {
+        wakeConsumer();
+    }
+    return true;
+}
+
+bool PacketQueue::pop(AVPacket *packet, bool wait)
+{
+    quint32 head = m_head.load(std::memory_order_relaxed);
+    int spin = 0;
+    for (;;) {
+        if (m_interrupted.load()) {
+            return false;
+        }
+        if (m_tail.load(std::memory_order_acquire) != head) {
+            break;
+        }
+        if (m_finished.load()) {
+            // finish() comes after the last push, check the tail once more
+            if (m_tail.load() != head) {
+                continue;
+            }
+            return false;
+        }
+        if (!wait) {
+            return false;
+        }
+        if (spin < m_spin) {
+            // the producer is often about to push, parking costs two context switches
+            spin++;
+            QThread::yieldCurrentThread();
+            continue;
+        }
+        QMutexLocker locker(&m_parkMutex);
+        m_consumerParked.store(true);
+        if (m_tail.load() == head && !m_interrupted.load() && !m_finished.load()) {
+            if (m_maxDelayMs) {
+                m_notEmptyCond.wait(&m_parkMutex, m_maxDelayMs);
+            } else {
+                m_notEmptyCond.wait(&m_parkMutex);
+            }
+        }
+        m_consumerParked.store(false);
+    }
+
+    av_packet_move_ref(packet, m_slots[head & m_mask]);
+    m_head.store(head + 1);
+
+    if (m_producerParked.load()) {
+        wakeProducer();
+    }
+    return true;
+}
+
+bool PacketQueue::isEmpty() const
+{
+    return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_relaxed);
+}
+
+bool PacketQueue::isFinished() const
+{
+    // the tail is final once finished is set
+    return m_finished.load() && isEmpty();
+}
+
+void PacketQueue::finish()
+{
+    QMutexLocker locker(&m_parkMutex);
+    m_finished.store(true);
+    m_notEmptyCond.wakeAll();
+}
+
+void PacketQueue::interrupt()
+{
+    QMutexLocker locker(&m_parkMutex);
+    m_interrupted.store(true);
+    m_notEmptyCond.wakeAll();
+    m_notFullCond.wakeAll();
+}
+
+void PacketQueue::clear()
+{
+    quint32 tail = m_tail.load();
+    for (quint32 head = m_head.load(); head != tail; head++) {
+        av_packet_unref(m_slots[head & m_mask]);
+    }
+    m_head.store(tail);
+    m_dropping = false;
+}
+
+qsc::PacketQueueStats PacketQueue::stats()
+{
+    qsc::PacketQueueStats stats;
+    stats.capacity = static_cast<int>(m_mask + 1);
+    stats.depth = static_cast<int>(m_tail.load() - m_head.load());
+    stats.maxDepth = static_cast<int>(m_maxDepth.load());
+    stats.pushed = m_pushed.load();
+    stats.dropped = m_dropped.load();
+    stats.blocked = m_blocked.load();
+    stats.wakeups = m_wakeups.load();
+    return stats;
+}
+
+void PacketQueue::resetStats()
+{
+    m_maxDepth.store(0);
+    m_pushed.store(0);
+    m_dropped.store(0);
+    m_blocked.store(0);
+    m_wakeups.store(0);
+}
+
+void PacketQueue::wakeConsumer()
+{
+    // taking the mutex makes sure the consumer is either waiting or will see the new tail
+    QMutexLocker locker(&m_parkMutex);
+    m_notEmptyCond.wakeOne();
+    m_wakeups++;
+}
+
+void PacketQueue::wakeProducer()
+{
+    QMutexLocker locker(&m_parkMutex);
+    m_notFullCond.wakeOne();
+}
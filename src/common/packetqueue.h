@@ -0,0 +1,96 @@
+#ifndef PACKETQUEUE_H
+#define PACKETQUEUE_H
+
+#include <atomic>
+
+#include <QMutex>
+#include <QWaitCondition>
+
+#include "../../include/QtScrcpyCoreDef.h"
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+}
+
+// Bounded single producer / single consumer packet queue.
+// The slots are preallocated AVPacket shells: push() refs the packet data into
+// the tail slot, pop() moves it out of the head slot, the fast path takes no lock.
+// A blocked consumer (empty) or producer (full, OVERFLOW_BLOCK) parks on a
+// condition and is woken by the other side. The consumer may spin a little
+// before parking, and be woken by batches instead of for every packet.
+class PacketQueue
+{
+public:
+    enum OverflowPolicy
+    {
+        OVERFLOW_BLOCK = 0,             // the producer waits for a free slot
+        OVERFLOW_DROP_UNTIL_KEY_FRAME,  // drop packets until the next key frame fits
+    };
+
+    // capacity is rounded up to a power of two
+    PacketQueue(int capacity, OverflowPolicy policy = OVERFLOW_BLOCK);
+    virtual ~PacketQueue();
+
+    // consumer wake up tuning, must be called before use
+    // batch: a parked consumer is only woken once that many packets are queued,
+    // it wakes up by itself after maxDelayMs to take a smaller batch
+    void setWakeupBatch(int batch, int maxDelayMs);
+    // number of yields before the consumer parks on an empty queue
+    void setSpin(int spin);
+
+    // producer: false if the packet was dropped or the queue interrupted
+    bool push(const AVPacket *packet);
+    // consumer: moves the oldest packet into packet (which must be blank),
+    // false if empty (and !wait) or interrupted
+    bool pop(AVPacket *packet, bool wait = true);
+    // consumer: true if a packet is available
+    bool isEmpty() const;
+    // consumer: finish() was called and every packet was popped
+    bool isFinished() const;
+
+    // producer: no more packets, pop() returns the queued ones then false
+    void finish();
+    // wake up both sides and make any further call return false
+    void interrupt();
+    // drop the queued packets, only when neither side is running
+    void clear();
+
+    qsc::PacketQueueStats stats();
+    void resetStats();
+
+private:
+    void wakeConsumer();
+    void wakeProducer();
+
+private:
+    AVPacket **m_slots = Q_NULLPTR;
+    quint32 m_mask = 0;
+    OverflowPolicy m_policy = OVERFLOW_BLOCK;
+    int m_wakeupBatch = 1;
+    int m_maxDelayMs = 0;
+    int m_spin = 0;
+
+    // head is written by the consumer only, tail by the producer only
+    std::atomic<quint32> m_head;
+    std::atomic<quint32> m_tail;
+    std::atomic<bool> m_interrupted;
+    std::atomic<bool> m_finished;
+    // producer side only
+    bool m_dropping = false;
+
+    QMutex m_parkMutex;
+    QWaitCondition m_notEmptyCond;
+    QWaitCondition m_notFullCond;
+    std::atomic<bool> m_consumerParked;
+    std::atomic<bool> m_producerParked;
+
+    // metrics
+    std::atomic<quint64> m_pushed;
+    std::atomic<quint64> m_dropped;
+    std::atomic<quint64> m_blocked;
+    std::atomic<quint64> m_wakeups;
+    std::atomic<quint32> m_maxDepth;
+};
+
+#endif // PACKETQUEUE_H
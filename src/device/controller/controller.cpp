@@ -141,6 +141,15 @@ void Controller::collapsePanel()
     postControlMsg(controlMsg);
 }
 
+void Controller::resetVideo()
+{
+    ControlMsg *controlMsg = new ControlMsg(ControlMsg::CMT_RESET_VIDEO);
+    if (!controlMsg) {
+        return;
+    }
+    postControlMsg(controlMsg);
+}
+
 void Controller::requestDeviceClipboard()
 {
     ControlMsg *controlMsg = new ControlMsg(ControlMsg::CMT_GET_CLIPBOARD);
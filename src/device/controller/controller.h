@@ -36,6 +36,8 @@ public:
     void cut();
     void expandNotificationPanel();
     void collapsePanel();
+    // ask the device encoder for a new key frame
+    void resetVideo();
     void setDisplayPower(bool on);
 
     // for input convert
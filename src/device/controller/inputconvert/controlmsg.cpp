@@ -188,6 +188,7 @@ QByteArray ControlMsg::serializeData()
     case CMT_EXPAND_SETTINGS_PANEL:
     case CMT_COLLAPSE_PANELS:
     case CMT_ROTATE_DEVICE:
+    case CMT_RESET_VIDEO:
         break;
     default:
         qDebug() << "Unknown event type:" << m_data.type;
@@ -41,7 +41,8 @@ public:
         CMT_GET_CLIPBOARD,
         CMT_SET_CLIPBOARD,
         CMT_SET_DISPLAY_POWER,
-        CMT_ROTATE_DEVICE
+        CMT_ROTATE_DEVICE,
+        CMT_RESET_VIDEO = 17, // server >= 3.0, the encoder restarts with a key frame
     };
 
     enum GetClipboardCopyKey {
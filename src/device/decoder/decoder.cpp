@@ -1,13 +1,92 @@
 #include <QDebug>
+#include <QMutex>
+#include <QThread>
 
 #include "compat.h"
 #include "decoder.h"
+#include "latencytracker.h"
+#include "packetqueue.h"
 #include "videobuffer.h"
 
-Decoder::Decoder(std::function<void(int, int, uint8_t*, uint8_t*, uint8_t*, int, int, int)> onFrame, QObject *parent)
+// decoding threads budget shared by all the decoders
+static QMutex s_threadsMutex;
+static int s_maxThreads = 0;
+static int s_usedThreads = 0;
+
+static int acquireThreads(int wanted)
+{
+    QMutexLocker locker(&s_threadsMutex);
+    int granted = wanted;
+    if (s_maxThreads > 0) {
+        // a decoder always gets at least one thread
+        granted = qBound(1, s_maxThreads - s_usedThreads, wanted);
+    }
+    s_usedThreads += granted;
+    return granted;
+}
+
+static void releaseThreads(int threads)
+{
+    QMutexLocker locker(&s_threadsMutex);
+    s_usedThreads -= threads;
+}
+
+// gives the threads back unless the decoder kept them (open() failed)
+class ThreadsGuard
+{
+public:
+    explicit ThreadsGuard(int &threads) : m_threads(threads) {}
+    ~ThreadsGuard()
+    {
+        if (!m_kept) {
+            releaseThreads(m_threads);
+            m_threads = 0;
+        }
+    }
+    void keep() { m_kept = true; }
+
+private:
+    int &m_threads;
+    bool m_kept = false;
+};
+
+class DecodeThread : public QThread
+{
+public:
+    DecodeThread(PacketQueue *packetQueue, std::function<bool(const AVPacket *)> decode)
+        : m_packetQueue(packetQueue), m_decode(decode)
+    {}
+
+protected:
+    void run() override
+    {
+        AVPacket *packet = av_packet_alloc();
+        if (!packet) {
+            qCritical("OOM");
+            return;
+        }
+        // until interrupted
+        while (m_packetQueue->pop(packet)) {
+            // as push() without a queue: the stream goes on with the next packet
+            if (!m_decode(packet)) {
+                qCritical("Could not send packet to decoder");
+            }
+            av_packet_unref(packet);
+        }
+        av_packet_free(&packet);
+    }
+
+private:
+    PacketQueue *m_packetQueue = Q_NULLPTR;
+    std::function<bool(const AVPacket *)> m_decode;
+};
+
+Decoder::Decoder(std::function<void(const AVFrame *)> onFrame, QObject *parent)
     : QObject(parent)
     , m_vb(new VideoBuffer())
     , m_onFrame(onFrame)
+    , m_consumptionState(qsc::CS_FOCUSED)
+    , m_maxDeliverFps(0)
 {
     m_vb->init();
     connect(this, &Decoder::newFrame, this, &Decoder::onNewFrame, Qt::QueuedConnection);
@@ -19,12 +98,117 @@ Decoder::~Decoder() {
     delete m_vb;
 }
 
-bool Decoder::open()
+void Decoder::setLatencyTracker(LatencyTracker *latencyTracker)
+{
+    m_latencyTracker = latencyTracker;
+    m_vb->setLatencyTracker(latencyTracker);
+}
+
+bool Decoder::isSupported(AVCodecID codecId)
+{
+    return avcodec_find_decoder(codecId) != Q_NULLPTR;
+}
+
+void Decoder::setMaxThreads(int maxThreads)
+{
+    QMutexLocker locker(&s_threadsMutex);
+    s_maxThreads = qMax(0, maxThreads);
+}
+
+void Decoder::setThreading(int threads, bool frameThreads)
+{
+    m_threads = qMax(0, threads);
+    m_frameThreads = frameThreads;
+}
+
+void Decoder::setPacketQueue(int capacity, bool dropUntilKeyFrame)
+{
+    m_queueCapacity = qMax(0, capacity);
+    m_queueDropUntilKeyFrame = dropUntilKeyFrame;
+}
+
+void Decoder::setFrameBuffer(qsc::FrameBufferPolicy policy, int depth)
+{
+    VideoBuffer::Policy vbPolicy = VideoBuffer::POLICY_LATEST;
+    if (qsc::FBP_FIFO == policy) {
+        vbPolicy = VideoBuffer::POLICY_FIFO;
+    } else if (qsc::FBP_BLOCK == policy) {
+        vbPolicy = VideoBuffer::POLICY_BLOCK;
+    }
+    // the ring is sized in init()
+    m_vb->deInit();
+    m_vb->setPolicy(vbPolicy, depth);
+    m_vb->init();
+}
+
+void Decoder::setFrameTap(std::function<void(const AVFrame *)> onFrame)
+{
+    m_frameTap = onFrame;
+}
+
+void Decoder::setConsumptionState(qsc::ConsumptionState state, quint32 maxFps)
+{
+    m_maxDeliverFps.store(maxFps);
+    m_consumptionState.store(state);
+}
+
+void Decoder::setThumbnail(int width, AVPixelFormat format, quint32 fps)
+{
+    m_thumbnail = width > 0;
+    m_thumbnailScaler.setOutput(width, format);
+    m_thumbnailFps = fps;
+}
+
+void Decoder::setThumbnailProfile(bool keyFramesOnly)
+{
+    m_thumbnailProfile = true;
+    m_thumbnailKeyFramesOnly = keyFramesOnly;
+}
+
+void Decoder::setDirtyDetection(int tileSize, int threshold)
+{
+    m_dirtyDetection = true;
+    m_dirtyDetector.setup(tileSize, threshold);
+}
+
+void Decoder::setMotionExport(int cellSize)
+{
+    m_motionExport = true;
+    m_motionAnalyzer.setup(cellSize);
+}
+
+void Decoder::setScheduler(DecodeScheduler *scheduler, int weight)
+{
+    m_scheduler = scheduler;
+    m_schedulerWeight = qMax(1, weight);
+}
+
+int Decoder::threadCount()
+{
+    return m_grantedThreads;
+}
+
+qsc::PacketQueueStats Decoder::packetQueueStats()
+{
+    if (!m_packetQueue) {
+        return qsc::PacketQueueStats();
+    }
+    return m_packetQueue->stats();
+}
+
+void Decoder::resetPacketQueueStats()
+{
+    if (m_packetQueue) {
+        m_packetQueue->resetStats();
+    }
+}
+
+bool Decoder::open(AVCodecID codecId)
 {
     // codec
-    const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    const AVCodec* codec = avcodec_find_decoder(codecId);
     if (!codec) {
-        qCritical("H.264 decoder not found");
+        qCritical("%s decoder not found", avcodec_get_name(codecId));
         return false;
     }
 
@@ -34,11 +218,55 @@ bool Decoder::open()
         qCritical("Could not allocate decoder context");
         return false;
     }
+
+    // resolve "auto" here so that it counts against the budget
+    m_grantedThreads = acquireThreads(m_threads ? m_threads : QThread::idealThreadCount());
+    ThreadsGuard threadsGuard(m_grantedThreads);
+    m_codecCtx->thread_count = m_grantedThreads;
+    if (m_frameThreads) {
+        // each thread delays the output by one frame
+        m_codecCtx->thread_type = FF_THREAD_FRAME;
+    } else {
+        m_codecCtx->thread_type = FF_THREAD_SLICE;
+        // output a frame as soon as it is decoded (disables frame threading)
+        m_codecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+    }
+    if (m_thumbnailProfile) {
+        // non spec compliant speedups, the artifacts are not visible on a thumbnail
+        m_codecCtx->flags2 |= AV_CODEC_FLAG2_FAST;
+        m_codecCtx->skip_loop_filter = AVDISCARD_ALL;
+    }
+    // only the h264 decoder exports the vectors, a frame without them would
+    // look fully intra coded
+    m_motionVectors = m_motionExport && AV_CODEC_ID_H264 == codecId;
+    if (m_motionVectors) {
+        // the vectors are a by-product of the decoding, exporting them is almost free
+        m_codecCtx->export_side_data |= AV_CODEC_EXPORT_DATA_MVS;
+    } else if (m_motionExport) {
+        qWarning("motion export is not supported with %s, disabled", codec->name);
+    }
+    qInfo("decoder threads: %d (%s)", m_grantedThreads, m_frameThreads ? "frame" : "slice");
+
     if (avcodec_open2(m_codecCtx, codec, NULL) < 0) {
-        qCritical("Could not open H.264 codec");
+        qCritical("Could not open %s codec", codec->name);
         return false;
     }
     m_isCodecCtxOpen = true;
+
+    // the shared pool always needs a queue to take the packets from
+    int queueCapacity = m_scheduler ? qMax(m_queueCapacity, 16) : m_queueCapacity;
+    if (queueCapacity > 0) {
+        m_packetQueue = new PacketQueue(queueCapacity,
+                                        m_queueDropUntilKeyFrame ? PacketQueue::OVERFLOW_DROP_UNTIL_KEY_FRAME : PacketQueue::OVERFLOW_BLOCK);
+    }
+    if (m_scheduler) {
+        m_strandPacket = av_packet_alloc();
+        m_strand = m_scheduler->addStrand([this](int maxPackets) -> bool { return decodePending(maxPackets); }, m_schedulerWeight);
+    } else if (m_packetQueue) {
+        m_decodeThread = new DecodeThread(m_packetQueue, [this](const AVPacket *packet) -> bool { return decode(packet); });
+        m_decodeThread->start();
+    }
+    threadsGuard.keep();
     return true;
 }
 
@@ -48,21 +276,76 @@ void Decoder::close()
         m_vb->interrupt();
     }
 
+    if (m_decodeThread) {
+        m_packetQueue->interrupt();
+        m_decodeThread->wait();
+        delete m_decodeThread;
+        m_decodeThread = Q_NULLPTR;
+    }
+    if (m_strand) {
+        m_packetQueue->interrupt();
+        m_scheduler->removeStrand(m_strand);
+        m_strand = Q_NULLPTR;
+        av_packet_free(&m_strandPacket);
+    }
+    if (m_packetQueue) {
+        delete m_packetQueue;
+        m_packetQueue = Q_NULLPTR;
+    }
+    // the decoding thread is stopped, give the reference frame back
+    m_dirtyDetector.reset();
+    m_dirtySkipping = false;
+
     if (!m_codecCtx) {
         return;
     }
     if (m_isCodecCtxOpen) {
         avcodec_close(m_codecCtx);
+        m_isCodecCtxOpen = false;
     }
     avcodec_free_context(&m_codecCtx);
+    releaseThreads(m_grantedThreads);
+    m_grantedThreads = 0;
 }
 
 bool Decoder::push(const AVPacket *packet)
+{
+    if (m_packetQueue) {
+        // a packet dropped by the overflow policy is not an error
+        if (m_packetQueue->push(packet) && m_strand) {
+            m_scheduler->schedule(m_strand);
+        }
+        return true;
+    }
+    return decode(packet);
+}
+
+bool Decoder::decodePending(int maxPackets)
+{
+    // runs on a DecodeScheduler worker, never concurrently
+    for (int i = 0; i < maxPackets; i++) {
+        if (!m_packetQueue->pop(m_strandPacket, false)) {
+            return false;
+        }
+        if (!decode(m_strandPacket)) {
+            qCritical("Could not send packet to decoder");
+        }
+        av_packet_unref(m_strandPacket);
+    }
+    return !m_packetQueue->isEmpty();
+}
+
+bool Decoder::decode(const AVPacket *packet)
 {
     if (!m_codecCtx || !m_vb) {
         return false;
     }
+    applyConsumptionState(packet);
     AVFrame *decodingFrame = m_vb->decodingFrame();
+    if (m_latencyTracker) {
+        m_latencyTracker->mark(LatencyTracker::STAGE_DECODE_SEND, packet->pts);
+    }
+    qint64 decodeStart = LatencyTracker::now();
 #ifdef QTSCRCPY_LAVF_HAS_NEW_ENCODING_DECODING_API
     int ret = -1;
     if ((ret = avcodec_send_packet(m_codecCtx, packet)) < 0) {
@@ -74,8 +357,14 @@ bool Decoder::push(const AVPacket *packet)
     if (decodingFrame) {
         ret = avcodec_receive_frame(m_codecCtx, decodingFrame);
     }
+    if (m_latencyTracker) {
+        m_latencyTracker->addDecodeTime(LatencyTracker::now() - decodeStart);
+    }
     if (!ret) {
         // a frame was received
+        if (m_latencyTracker) {
+            m_latencyTracker->mark(LatencyTracker::STAGE_DECODE_RECEIVE, decodingFrame->pts);
+        }
         pushFrame();
 
         //emit getOneFrame(yuvDecoderFrame->data[0], yuvDecoderFrame->data[1], yuvDecoderFrame->data[2],
@@ -109,23 +398,54 @@ bool Decoder::push(const AVPacket *packet)
     if (decodingFrame) {
         len = avcodec_decode_video2(m_codecCtx, decodingFrame, &gotPicture, packet);
     }
+    if (m_latencyTracker) {
+        m_latencyTracker->addDecodeTime(LatencyTracker::now() - decodeStart);
+    }
     if (len < 0) {
         qCritical("Could not decode video packet: %d", len);
         return false;
     }
     if (gotPicture) {
+        if (m_latencyTracker) {
+            m_latencyTracker->mark(LatencyTracker::STAGE_DECODE_RECEIVE, decodingFrame->pts);
+        }
         pushFrame();
     }
 #endif
     return true;
 }
 
-void Decoder::peekFrame(std::function<void (int, int, uint8_t *)> onFrame)
+void Decoder::applyConsumptionState(const AVPacket *packet)
+{
+    int state = m_consumptionState.load();
+    if (state != m_appliedConsumptionState) {
+        if (qsc::CS_HIDDEN == m_appliedConsumptionState) {
+            // the references of the coming non key frames were skipped
+            m_waitKeyFrame = true;
+        }
+        m_appliedConsumptionState = state;
+        // deblocking is a large part of the h264 decoding cost, and the
+        // artifacts are not visible on a thumbnail
+        bool skipLoopFilter = m_thumbnailProfile || qsc::CS_THUMBNAIL == state;
+        m_codecCtx->skip_loop_filter = skipLoopFilter ? AVDISCARD_ALL : AVDISCARD_DEFAULT;
+    }
+    if (m_waitKeyFrame && (packet->flags & AV_PKT_FLAG_KEY)) {
+        m_waitKeyFrame = false;
+    }
+    bool keyFramesOnly = qsc::CS_HIDDEN == state || m_waitKeyFrame || m_thumbnailKeyFramesOnly;
+    m_codecCtx->skip_frame = keyFramesOnly ? AVDISCARD_NONKEY : AVDISCARD_DEFAULT;
+    if (m_dirtyDetection && keyFramesOnly != m_dirtySkipping) {
+        m_dirtySkipping = keyFramesOnly;
+        emit dirtyDetectionSkipping(keyFramesOnly);
+    }
+}
+
+qsc::FrameRef Decoder::lastFrame()
 {
     if (!m_vb) {
-        return;
+        return qsc::FrameRef();
     }
-    m_vb->peekRenderedFrame(onFrame);
+    return m_vb->lastFrame();
 }
 
 void Decoder::pushFrame()
@@ -133,22 +453,71 @@ void Decoder::pushFrame()
     if (!m_vb) {
         return;
     }
-    bool previousFrameSkipped = true;
-    m_vb->offerDecodedFrame(previousFrameSkipped);
-    if (previousFrameSkipped) {
-        // the previous newFrame will consume this frame
+    AVFrame *frame = m_vb->decodingFrame();
+    if (m_dirtyDetection) {
+        // every decoded frame, before the rate caps
+        qsc::DirtyRegion region;
+        if (m_dirtyDetector.analyze(frame, region)) {
+            emit newDirtyRegion(region);
+        }
+    }
+    if (m_motionVectors) {
+        qsc::MotionInfo motion;
+        if (m_motionAnalyzer.analyze(frame, motion)) {
+            emit newMotion(motion);
+        }
+    }
+    if (m_thumbnail) {
+        pushThumbnail(frame);
+    }
+    if (m_thumbnailProfile) {
+        av_frame_unref(frame);
+        return;
+    }
+    // delivery rate cap of the consumption state, on the device timestamps
+    quint32 maxFps = m_maxDeliverFps.load();
+    if (maxFps && AV_NOPTS_VALUE != frame->pts && AV_NOPTS_VALUE != m_lastDeliverPts && frame->pts >= m_lastDeliverPts
+        && frame->pts - m_lastDeliverPts < 1000000 / maxFps) {
+        av_frame_unref(frame);
+        return;
+    }
+    m_lastDeliverPts = frame->pts;
+    if (m_frameTap) {
+        m_frameTap(frame);
+    }
+    bool needNotify = false;
+    m_vb->offerDecodedFrame(needNotify);
+    if (!needNotify) {
+        // the pending newFrame will take this frame too
         return;
     }
     emit newFrame();
 }
 
-void Decoder::onNewFrame() {
-    if (!m_onFrame) {
+void Decoder::pushThumbnail(const AVFrame *frame)
+{
+    if (m_thumbnailFps && AV_NOPTS_VALUE != frame->pts && AV_NOPTS_VALUE != m_lastThumbnailPts && frame->pts >= m_lastThumbnailPts
+        && frame->pts - m_lastThumbnailPts < 1000000 / m_thumbnailFps) {
+        return;
+    }
+    qsc::FrameRef thumbnail = m_thumbnailScaler.scale(frame);
+    if (!thumbnail.isValid()) {
         return;
     }
+    m_lastThumbnailPts = frame->pts;
+    emit newThumbnail(thumbnail);
+}
 
-    m_vb->lock();
-    const AVFrame *frame = m_vb->consumeRenderedFrame();
-    m_onFrame(frame->width, frame->height, frame->data[0], frame->data[1], frame->data[2], frame->linesize[0], frame->linesize[1], frame->linesize[2]);
-    m_vb->unLock();
+void Decoder::onNewFrame() {
+    // deliver everything in the ring, in order
+    AVFrame *frame = Q_NULLPTR;
+    while ((frame = m_vb->takeFrame())) {
+        if (m_latencyTracker) {
+            m_latencyTracker->mark(LatencyTracker::STAGE_DELIVER, frame->pts);
+        }
+        if (m_onFrame) {
+            m_onFrame(frame);
+        }
+        m_vb->releaseFrame(frame);
+    }
 }
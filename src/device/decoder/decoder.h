@@ -7,23 +7,76 @@ extern "C"
 #include "libavcodec/avcodec.h"
 }
 
+#include <atomic>
 #include <functional>
 
+#include "../../../include/QtScrcpyCoreDef.h"
+#include "decodescheduler.h"
+#include "dirtydetector.h"
+#include "motionanalyzer.h"
+#include "thumbnailscaler.h"
+
 class VideoBuffer;
+class LatencyTracker;
+class PacketQueue;
+class DecodeThread;
 class Decoder : public QObject
 {
     Q_OBJECT
 public:
-    Decoder(std::function<void(int width, int height, uint8_t* dataY, uint8_t* dataU, uint8_t* dataV, int linesizeY, int linesizeU, int linesizeV)> onFrame, QObject *parent = Q_NULLPTR);
+    // onFrame runs on the decoder's thread, frame is valid during the call only
+    Decoder(std::function<void(const AVFrame *frame)> onFrame, QObject *parent = Q_NULLPTR);
     virtual ~Decoder();
 
-    bool open();
+    static bool isSupported(AVCodecID codecId);
+    // cap of the decoding threads of all the decoders of the process, 0 for no cap
+    static void setMaxThreads(int maxThreads);
+
+    void setLatencyTracker(LatencyTracker *latencyTracker);
+    // threads: 0 for auto, frameThreads: frame instead of slice threading
+    void setThreading(int threads, bool frameThreads);
+    // decode on a dedicated thread fed by a bounded packet queue, so that push()
+    // (on the demuxer thread) does not wait for the decoding, 0 to decode in push()
+    void setPacketQueue(int capacity, bool dropUntilKeyFrame);
+    // decode on a shared pool instead of a dedicated thread, weight: packets per turn
+    void setScheduler(DecodeScheduler *scheduler, int weight);
+    // how decoded frames wait for onFrame, must be called before open()
+    void setFrameBuffer(qsc::FrameBufferPolicy policy, int depth);
+    // called on the decoding thread for every decoded frame, before the frame
+    // buffer, frame is valid during the call only
+    void setFrameTap(std::function<void(const AVFrame *frame)> onFrame);
+    // thread safe, applied from the next packet
+    // maxFps: cap of the frames given to onFrame/the frame tap, 0 for no cap
+    void setConsumptionState(qsc::ConsumptionState state, quint32 maxFps);
+    // emit newThumbnail at up to fps (0 for every frame), must be called before open()
+    void setThumbnail(int width, AVPixelFormat format, quint32 fps);
+    // cheap decoding settings for thumbnails, the full frames are not delivered
+    // anymore, must be called before open()
+    void setThumbnailProfile(bool keyFramesOnly);
+    // emit newDirtyRegion when tiles of the Y plane change, must be called before open()
+    void setDirtyDetection(int tileSize, int threshold);
+    // export the motion vectors and emit newMotion (h264 only), must be called before open()
+    void setMotionExport(int cellSize);
+    bool open(AVCodecID codecId = AV_CODEC_ID_H264);
     void close();
     bool push(const AVPacket *packet);
-    void peekFrame(std::function<void(int width, int height, uint8_t* dataRGB32)> onFrame);
+    int threadCount();
+    qsc::PacketQueueStats packetQueueStats();
+    void resetPacketQueueStats();
+    // reference to the last frame handed to the observers
+    qsc::FrameRef lastFrame();
 
 signals:
     void updateFPS(quint32 fps);
+    // emitted on the decoding thread
+    void newThumbnail(qsc::FrameRef thumbnail);
+    // emitted on the decoding thread
+    void newDirtyRegion(qsc::DirtyRegion region);
+    // emitted on the decoding thread when the non key frames stop/start being
+    // decoded, the changes in between are not seen
+    void dirtyDetectionSkipping(bool skipping);
+    // emitted on the decoding thread
+    void newMotion(qsc::MotionInfo motion);
 
 private slots:
     void onNewFrame();
@@ -32,13 +85,54 @@ signals:
     void newFrame();
 
 private:
+    bool decode(const AVPacket *packet);
+    bool decodePending(int maxPackets);
+    void applyConsumptionState(const AVPacket *packet);
+    void pushThumbnail(const AVFrame *frame);
     void pushFrame();
 
 private:
     VideoBuffer *m_vb = Q_NULLPTR;
     AVCodecContext *m_codecCtx = Q_NULLPTR;
     bool m_isCodecCtxOpen = false;
-    std::function<void(int, int, uint8_t*, uint8_t*, uint8_t*, int, int, int)> m_onFrame = Q_NULLPTR;
+    int m_threads = 1;
+    bool m_frameThreads = false;
+    int m_grantedThreads = 0;
+    int m_queueCapacity = 0;
+    bool m_queueDropUntilKeyFrame = false;
+    PacketQueue *m_packetQueue = Q_NULLPTR;
+    DecodeThread *m_decodeThread = Q_NULLPTR;
+    DecodeScheduler *m_scheduler = Q_NULLPTR;
+    int m_schedulerWeight = 1;
+    DecodeScheduler::Strand *m_strand = Q_NULLPTR;
+    AVPacket *m_strandPacket = Q_NULLPTR;
+    LatencyTracker *m_latencyTracker = Q_NULLPTR;
+    std::function<void(const AVFrame *)> m_onFrame = Q_NULLPTR;
+    std::function<void(const AVFrame *)> m_frameTap = Q_NULLPTR;
+
+    // set by the GUI thread, applied on the decoding thread
+    std::atomic<int> m_consumptionState;
+    std::atomic<quint32> m_maxDeliverFps;
+    // decoding thread only
+    int m_appliedConsumptionState = qsc::CS_FOCUSED;
+    bool m_waitKeyFrame = false;
+    qint64 m_lastDeliverPts = AV_NOPTS_VALUE;
+
+    ThumbnailScaler m_thumbnailScaler;
+    bool m_thumbnail = false;
+    quint32 m_thumbnailFps = 0;
+    qint64 m_lastThumbnailPts = AV_NOPTS_VALUE;
+    bool m_thumbnailProfile = false;
+    bool m_thumbnailKeyFramesOnly = false;
+
+    DirtyDetector m_dirtyDetector;
+    bool m_dirtyDetection = false;
+    bool m_dirtySkipping = false;
+
+    MotionAnalyzer m_motionAnalyzer;
+    bool m_motionExport = false;
+    // the codec exports the vectors
+    bool m_motionVectors = false;
 };
 
 #endif // DECODER_H
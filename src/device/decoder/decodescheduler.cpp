@@ -0,0 +1,198 @@
+#include <QMutexLocker>
+
+#include "decodescheduler.h"
+
+class DecodeScheduler::Strand
+{
+public:
+    enum State
+    {
+        STATE_IDLE = 0,
+        STATE_SCHEDULED,       // in a work queue
+        STATE_RUNNING,         // on a worker
+        STATE_RUNNING_PENDING, // on a worker, and scheduled again meanwhile
+    };
+
+    Strand(const StrandFunc &func, int weight, int home) : func(func), weight(weight), home(home), state(STATE_IDLE), removed(false) {}
+
+    StrandFunc func;
+    int weight = 1;
+    int home = 0; // preferred worker, keeps a stream on the same core when possible
+    std::atomic<int> state;
+    std::atomic<bool> removed;
+};
+
+class DecodeWorker : public QThread
+{
+public:
+    DecodeWorker(DecodeScheduler *scheduler, int index) : m_scheduler(scheduler), m_index(index) {}
+
+protected:
+    void run() override { m_scheduler->runWorker(m_index); }
+
+private:
+    DecodeScheduler *m_scheduler = Q_NULLPTR;
+    int m_index = 0;
+};
+
+DecodeScheduler::DecodeScheduler(int workers) : m_queued(0), m_parked(0), m_stopped(false), m_nextHome(0)
+{
+    workers = qMax(1, workers);
+    for (int i = 0; i < workers; i++) {
+        m_queues.append(new WorkQueue);
+    }
+    for (int i = 0; i < workers; i++) {
+        DecodeWorker *worker = new DecodeWorker(this, i);
+        m_workers.append(worker);
+        worker->start();
+    }
+}
+
+DecodeScheduler::~DecodeScheduler()
+{
+    {
+        QMutexLocker locker(&m_parkMutex);
+        m_stopped.store(true);
+        m_parkCond.wakeAll();
+    }
+    for (DecodeWorker *worker : m_workers) {
+        worker->wait();
+        delete worker;
+    }
+    for (WorkQueue *queue : m_queues) {
+        delete queue;
+    }
+}
+
+int DecodeScheduler::workerCount()
+{
+    return m_workers.size();
+}
+
+DecodeScheduler::Strand *DecodeScheduler::addStrand(const StrandFunc &func, int weight)
+{
+    int home = m_nextHome++ % m_workers.size();
+    return new Strand(func, qMax(1, weight), home);
+}
+
+void DecodeScheduler::removeStrand(Strand *strand)
+{
+    // the caller must not schedule it anymore
+    strand->removed.store(true);
+    {
+        QMutexLocker locker(&m_parkMutex);
+        while (Strand::STATE_IDLE != strand->state.load()) {
+            m_idleCond.wait(&m_parkMutex);
+        }
+    }
+    delete strand;
+}
+
+void DecodeScheduler::schedule(Strand *strand)
+{
+    for (;;) {
+        int state = strand->state.load();
+        if (Strand::STATE_IDLE == state) {
+            if (strand->state.compare_exchange_weak(state, Strand::STATE_SCHEDULED)) {
+                enqueue(strand, strand->home);
+                return;
+            }
+        } else if (Strand::STATE_RUNNING == state) {
+            // the worker picks it up again when done, keeping the order
+            if (strand->state.compare_exchange_weak(state, Strand::STATE_RUNNING_PENDING)) {
+                return;
+            }
+        } else {
+            return;
+        }
+    }
+}
+
+void DecodeScheduler::runWorker(int index)
+{
+    while (!m_stopped.load()) {
+        Strand *strand = takeStrand(index);
+        if (!strand) {
+            QMutexLocker locker(&m_parkMutex);
+            m_parked++;
+            if (!m_queued.load() && !m_stopped.load()) {
+                m_parkCond.wait(&m_parkMutex);
+            }
+            m_parked--;
+            continue;
+        }
+
+        strand->state.store(Strand::STATE_RUNNING);
+        bool more = false;
+        if (!strand->removed.load()) {
+            more = strand->func(strand->weight);
+        }
+        finishStrand(strand, more, index);
+    }
+}
+
+DecodeScheduler::Strand *DecodeScheduler::takeStrand(int index)
+{
+    if (!m_queued.load()) {
+        return Q_NULLPTR;
+    }
+    int count = m_queues.size();
+    for (int i = 0; i < count; i++) {
+        WorkQueue *queue = m_queues[(index + i) % count];
+        QMutexLocker locker(&queue->mutex);
+        if (queue->strands.isEmpty()) {
+            continue;
+        }
+        m_queued--;
+        if (!i) {
+            // own queue: oldest first
+            return queue->strands.takeFirst();
+        }
+        // steal the newest, the owner is busy with the oldest ones
+        return queue->strands.takeLast();
+    }
+    return Q_NULLPTR;
+}
+
+void DecodeScheduler::enqueue(Strand *strand, int index)
+{
+    {
+        WorkQueue *queue = m_queues[index];
+        QMutexLocker locker(&queue->mutex);
+        queue->strands.append(strand);
+        m_queued++;
+    }
+    if (m_parked.load()) {
+        QMutexLocker locker(&m_parkMutex);
+        m_parkCond.wakeOne();
+    }
+}
+
+void DecodeScheduler::finishStrand(Strand *strand, bool more, int index)
+{
+    bool removed = strand->removed.load();
+    if (!removed) {
+        if (!more) {
+            // once idle, removeStrand may delete the strand: it is published
+            // under the lock, and not touched after the lock is released
+            QMutexLocker locker(&m_parkMutex);
+            int state = Strand::STATE_RUNNING;
+            if (strand->state.compare_exchange_strong(state, Strand::STATE_IDLE)) {
+                if (strand->removed.load()) {
+                    // removed while running
+                    m_idleCond.wakeAll();
+                }
+                return;
+            }
+        }
+        // more packets (quantum used up) or scheduled while running: back of the
+        // queue, so that the other strands get their turn
+        strand->state.store(Strand::STATE_SCHEDULED);
+        enqueue(strand, index);
+        return;
+    }
+
+    QMutexLocker locker(&m_parkMutex);
+    strand->state.store(Strand::STATE_IDLE);
+    m_idleCond.wakeAll();
+}
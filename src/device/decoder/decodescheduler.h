@@ -0,0 +1,63 @@
+#ifndef DECODESCHEDULER_H
+#define DECODESCHEDULER_H
+
+#include <atomic>
+#include <functional>
+
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+#include <QWaitCondition>
+
+#include "../../../include/QtScrcpyCoreDef.h"
+
+class DecodeWorker;
+
+// Host wide decode pool: every decoder is a strand, its jobs run on a fixed
+// set of workers and never on two workers at a time, so the per stream packet
+// order is kept. An idle worker steals strands from the others.
+// A strand runs up to "weight" packets per turn, higher priority devices get
+// a bigger share of the pool.
+class DecodeScheduler
+{
+public:
+    class Strand;
+    // decodes up to maxPackets, returns true if more work is pending
+    typedef std::function<bool(int maxPackets)> StrandFunc;
+
+    DecodeScheduler(int workers);
+    virtual ~DecodeScheduler();
+
+    int workerCount();
+    Strand *addStrand(const StrandFunc &func, int weight);
+    // blocks until the strand is not running anymore, then deletes it
+    void removeStrand(Strand *strand);
+    // new work is available for the strand, thread safe
+    void schedule(Strand *strand);
+
+private:
+    friend class DecodeWorker;
+    void runWorker(int index);
+    Strand *takeStrand(int index);
+    void enqueue(Strand *strand, int index);
+    void finishStrand(Strand *strand, bool more, int index);
+
+private:
+    struct WorkQueue
+    {
+        QMutex mutex;
+        QVector<Strand *> strands;
+    };
+
+    QVector<DecodeWorker *> m_workers;
+    QVector<WorkQueue *> m_queues;
+    std::atomic<int> m_queued;
+    std::atomic<int> m_parked;
+    std::atomic<bool> m_stopped;
+    std::atomic<int> m_nextHome;
+    QMutex m_parkMutex;
+    QWaitCondition m_parkCond;
+    QWaitCondition m_idleCond;
+};
+
+#endif // DECODESCHEDULER_H
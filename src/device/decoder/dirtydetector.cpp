@@ -0,0 +1,250 @@
+#include <cstdlib>
+
+#include "dirtydetector.h"
+
+extern "C"
+{
+#include "libavutil/cpu.h"
+#include "libavutil/frame.h"
+}
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define DIRTYDETECTOR_X86
+#include <immintrin.h>
+#if defined(__GNUC__) || defined(__clang__)
+#define DIRTYDETECTOR_TARGET_SSE2 __attribute__((target("sse2")))
+#define DIRTYDETECTOR_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define DIRTYDETECTOR_TARGET_SSE2
+#define DIRTYDETECTOR_TARGET_AVX2
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define DIRTYDETECTOR_NEON
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// adds the SAD of each tile of one line to sums
+typedef void (*SadRowFunc)(const uint8_t *a, const uint8_t *b, int width, int tileSize, quint32 *sums);
+
+inline quint32 sadScalar(const uint8_t *a, const uint8_t *b, int begin, int end)
+{
+    quint32 sum = 0;
+    for (int x = begin; x < end; x++) {
+        sum += std::abs(a[x] - b[x]);
+    }
+    return sum;
+}
+
+void sadRowScalar(const uint8_t *a, const uint8_t *b, int width, int tileSize, quint32 *sums)
+{
+    for (int x0 = 0, c = 0; x0 < width; x0 += tileSize, c++) {
+        sums[c] += sadScalar(a, b, x0, qMin(width, x0 + tileSize));
+    }
+}
+
+#ifdef DIRTYDETECTOR_X86
+DIRTYDETECTOR_TARGET_SSE2 void sadRowSse2(const uint8_t *a, const uint8_t *b, int width, int tileSize, quint32 *sums)
+{
+    for (int x0 = 0, c = 0; x0 < width; x0 += tileSize, c++) {
+        int end = qMin(width, x0 + tileSize);
+        int x = x0;
+        __m128i acc = _mm_setzero_si128();
+        for (; x + 16 <= end; x += 16) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x));
+            acc = _mm_add_epi64(acc, _mm_sad_epu8(va, vb));
+        }
+        quint32 sum = static_cast<quint32>(_mm_cvtsi128_si32(acc) + _mm_cvtsi128_si32(_mm_srli_si128(acc, 8)));
+        sums[c] += sum + sadScalar(a, b, x, end);
+    }
+}
+
+DIRTYDETECTOR_TARGET_AVX2 void sadRowAvx2(const uint8_t *a, const uint8_t *b, int width, int tileSize, quint32 *sums)
+{
+    for (int x0 = 0, c = 0; x0 < width; x0 += tileSize, c++) {
+        int end = qMin(width, x0 + tileSize);
+        int x = x0;
+        __m256i acc = _mm256_setzero_si256();
+        for (; x + 32 <= end; x += 32) {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + x));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + x));
+            acc = _mm256_add_epi64(acc, _mm256_sad_epu8(va, vb));
+        }
+        __m128i acc128 = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+        if (x + 16 <= end) {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + x));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + x));
+            acc128 = _mm_add_epi64(acc128, _mm_sad_epu8(va, vb));
+            x += 16;
+        }
+        quint32 sum = static_cast<quint32>(_mm_cvtsi128_si32(acc128) + _mm_cvtsi128_si32(_mm_srli_si128(acc128, 8)));
+        sums[c] += sum + sadScalar(a, b, x, end);
+    }
+}
+#endif
+
+#ifdef DIRTYDETECTOR_NEON
+void sadRowNeon(const uint8_t *a, const uint8_t *b, int width, int tileSize, quint32 *sums)
+{
+    for (int x0 = 0, c = 0; x0 < width; x0 += tileSize, c++) {
+        int end = qMin(width, x0 + tileSize);
+        int x = x0;
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (; x + 16 <= end; x += 16) {
+            uint8x16_t diff = vabdq_u8(vld1q_u8(a + x), vld1q_u8(b + x));
+            acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+        }
+        sums[c] += vaddvq_u32(acc) + sadScalar(a, b, x, end);
+    }
+}
+#endif
+
+DirtyDetector::Kernel bestKernel()
+{
+#ifdef DIRTYDETECTOR_X86
+    int flags = av_get_cpu_flags();
+    if (flags & AV_CPU_FLAG_AVX2) {
+        return DirtyDetector::KERNEL_AVX2;
+    }
+    if (flags & AV_CPU_FLAG_SSE2) {
+        return DirtyDetector::KERNEL_SSE2;
+    }
+#endif
+#ifdef DIRTYDETECTOR_NEON
+    return DirtyDetector::KERNEL_NEON;
+#endif
+    return DirtyDetector::KERNEL_SCALAR;
+}
+
+SadRowFunc sadRowFunc(DirtyDetector::Kernel kernel)
+{
+    switch (kernel) {
+#ifdef DIRTYDETECTOR_X86
+    case DirtyDetector::KERNEL_SSE2:
+        return sadRowSse2;
+    case DirtyDetector::KERNEL_AVX2:
+        return sadRowAvx2;
+#endif
+#ifdef DIRTYDETECTOR_NEON
+    case DirtyDetector::KERNEL_NEON:
+        return sadRowNeon;
+#endif
+    default:
+        return sadRowScalar;
+    }
+}
+
+}
+
+DirtyDetector::DirtyDetector() {}
+
+DirtyDetector::~DirtyDetector() {}
+
+void DirtyDetector::setup(int tileSize, int threshold)
+{
+    // the SAD of a tile must fit in 32 bits
+    m_tileSize = qBound(8, tileSize, 256);
+    m_threshold = qMax(0, threshold);
+    reset();
+}
+
+void DirtyDetector::reset()
+{
+    m_previous.reset();
+}
+
+void DirtyDetector::setKernel(Kernel kernel)
+{
+    m_kernel = isKernelSupported(kernel) ? kernel : KERNEL_AUTO;
+}
+
+bool DirtyDetector::isKernelSupported(Kernel kernel)
+{
+    switch (kernel) {
+    case KERNEL_AUTO:
+    case KERNEL_SCALAR:
+        return true;
+#ifdef DIRTYDETECTOR_X86
+    case KERNEL_SSE2:
+        return av_get_cpu_flags() & AV_CPU_FLAG_SSE2;
+    case KERNEL_AVX2:
+        return av_get_cpu_flags() & AV_CPU_FLAG_AVX2;
+#endif
+#ifdef DIRTYDETECTOR_NEON
+    case KERNEL_NEON:
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+bool DirtyDetector::analyze(const AVFrame *frame, qsc::DirtyRegion &region)
+{
+    if (!frame || !frame->data[0] || frame->width <= 0 || frame->height <= 0) {
+        return false;
+    }
+    int width = frame->width;
+    int height = frame->height;
+    int tileSize = m_tileSize;
+    int columns = (width + tileSize - 1) / tileSize;
+    int rows = (height + tileSize - 1) / tileSize;
+
+    region.pts = frame->pts;
+    region.width = width;
+    region.height = height;
+    region.tileSize = tileSize;
+    region.columns = columns;
+    region.rows = rows;
+    region.tiles = QByteArray(columns * rows, 0);
+    region.dirtyTiles = 0;
+    region.bounds = QRect();
+
+    const AVFrame *previous = m_previous.avFrame();
+    if (!previous || previous->width != width || previous->height != height || previous->format != frame->format) {
+        // nothing to compare with
+        region.tiles.fill(1);
+        region.dirtyTiles = columns * rows;
+        region.bounds = QRect(0, 0, width, height);
+        m_previous = qsc::FrameRef(frame);
+        return true;
+    }
+
+    SadRowFunc sadRow = sadRowFunc(KERNEL_AUTO == m_kernel ? bestKernel() : m_kernel);
+    m_sums.resize(columns);
+    char *tiles = region.tiles.data();
+    int left = columns, top = rows, right = -1, bottom = -1;
+    for (int row = 0; row < rows; row++) {
+        int y0 = row * tileSize;
+        int y1 = qMin(height, y0 + tileSize);
+        m_sums.fill(0);
+        for (int y = y0; y < y1; y++) {
+            sadRow(frame->data[0] + y * frame->linesize[0], previous->data[0] + y * previous->linesize[0], width, tileSize, m_sums.data());
+        }
+        for (int column = 0; column < columns; column++) {
+            // mean difference per pixel above the threshold, without dividing
+            quint64 pixels = static_cast<quint64>(qMin(width, (column + 1) * tileSize) - column * tileSize) * (y1 - y0);
+            if (m_sums[column] <= pixels * m_threshold) {
+                continue;
+            }
+            tiles[row * columns + column] = 1;
+            region.dirtyTiles++;
+            left = qMin(left, column);
+            right = qMax(right, column);
+            top = qMin(top, row);
+            bottom = qMax(bottom, row);
+        }
+    }
+    if (!region.dirtyTiles) {
+        // keep the reference, slow changes add up until they reach the threshold
+        return false;
+    }
+    int x = left * tileSize;
+    int y = top * tileSize;
+    region.bounds = QRect(x, y, qMin(width, (right + 1) * tileSize) - x, qMin(height, (bottom + 1) * tileSize) - y);
+
+    m_previous = qsc::FrameRef(frame);
+    return true;
+}
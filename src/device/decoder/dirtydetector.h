@@ -0,0 +1,50 @@
+#ifndef DIRTYDETECTOR_H
+#define DIRTYDETECTOR_H
+
+#include <QMetaType>
+#include <QVector>
+
+#include "../../../include/QtScrcpyCoreDef.h"
+#include "../../../include/frameref.h"
+
+// Finds the tiles that changed since the previous frame, from the sum of
+// absolute differences of the Y plane (SSE2/AVX2/NEON, scalar fallback).
+// The reference frame is the last one with a change, so that slow changes add
+// up. Only a reference to it is kept, nothing is copied.
+class DirtyDetector
+{
+public:
+    enum Kernel
+    {
+        KERNEL_AUTO = 0, // best supported one
+        KERNEL_SCALAR,
+        KERNEL_SSE2,
+        KERNEL_AVX2,
+        KERNEL_NEON,
+    };
+
+    DirtyDetector();
+    virtual ~DirtyDetector();
+
+    // threshold: a tile is dirty when its mean difference per pixel is above it
+    void setup(int tileSize, int threshold);
+    // true if some tiles changed, the first frame and a new size are fully dirty
+    bool analyze(const AVFrame *frame, qsc::DirtyRegion &region);
+    void reset();
+
+    // for benchmarks/tests
+    void setKernel(Kernel kernel);
+    static bool isKernelSupported(Kernel kernel);
+
+private:
+    int m_tileSize = 32;
+    int m_threshold = 1;
+    Kernel m_kernel = KERNEL_AUTO;
+    qsc::FrameRef m_previous;
+    // SAD per tile of the current tile row
+    QVector<quint32> m_sums;
+};
+
+Q_DECLARE_METATYPE(qsc::DirtyRegion)
+
+#endif // DIRTYDETECTOR_H
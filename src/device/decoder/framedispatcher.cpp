@@ -0,0 +1,407 @@
+#include <QMutexLocker>
+#include <QQueue>
+#include <QRunnable>
+#include <QSharedPointer>
+#include <QThread>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include "framedispatcher.h"
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+using namespace qsc;
+
+static QThreadPool *deliveryPool()
+{
+    // shared by all the devices, never competes with QThreadPool::globalInstance()
+    static QThreadPool pool;
+    return &pool;
+}
+
+static void deliver(DeviceObserver *observer, const FrameRef &frameRef)
+{
+    const AVFrame *frame = frameRef.avFrame();
+    if (AV_PIX_FMT_YUV420P == frame->format) {
+        observer->onFrame(frame->width, frame->height, frame->data[0], frame->data[1], frame->data[2], frame->linesize[0], frame->linesize[1], frame->linesize[2]);
+    }
+    observer->onFrameRef(frameRef);
+}
+
+static AVPixelFormat toAVPixelFormat(OutputFormat format)
+{
+    switch (format) {
+    case OF_YUV420P:
+        return AV_PIX_FMT_YUV420P;
+    case OF_NV12:
+        return AV_PIX_FMT_NV12;
+    case OF_RGBA:
+        return AV_PIX_FMT_RGBA;
+    case OF_GRAY8:
+        return AV_PIX_FMT_GRAY8;
+    default:
+        return AV_PIX_FMT_NONE;
+    }
+}
+
+// a frame converted for the observers asking for the same output
+struct ConvertedFrame
+{
+    AVPixelFormat format = AV_PIX_FMT_NONE;
+    int width = 0;
+    int height = 0;
+    // held while converting, the other observers wait for the result
+    QMutex mutex;
+    bool done = false;
+    FrameRef frame;
+};
+
+// a decoded frame posted to the mailboxes, with its conversions done so far
+struct DispatchedFrame
+{
+    explicit DispatchedFrame(const FrameRef &source) : source(source) {}
+
+    FrameRef source;
+    QMutex mutex;
+    QVector<QSharedPointer<ConvertedFrame>> converted;
+};
+typedef QSharedPointer<DispatchedFrame> DispatchedFramePtr;
+
+class FrameMailbox
+{
+public:
+    FrameMailbox(DeviceObserver *observer, const ObserverOptions &options, QMutex *scalersMutex, ScalerCache *scalers)
+        : observer(observer), delivery(options.delivery), capacity(qMax(1, options.mailboxSize)), outputFormat(toAVPixelFormat(options.outputFormat)),
+          outputWidth(qMax(0, options.outputWidth)), outputHeight(qMax(0, options.outputHeight)), scalersMutex(scalersMutex), scalers(scalers)
+    {}
+
+    // source itself when no conversion is needed, converted on the calling thread
+    // if no other observer did it yet
+    FrameRef output(DispatchedFrame &dispatched) const;
+    // consumer thread
+    void deliverNext(const DispatchedFramePtr &dispatched);
+
+    // decoding thread
+    void post(const DispatchedFramePtr &dispatched);
+    // consumer: false if closed or (!wait and empty)
+    bool take(DispatchedFramePtr &dispatched, bool wait);
+    void close();
+
+    DeviceObserver *observer = Q_NULLPTR;
+    ObserverDelivery delivery = OD_GUI_THREAD;
+    int capacity = 1;
+    AVPixelFormat outputFormat = AV_PIX_FMT_NONE;
+    int outputWidth = 0;
+    int outputHeight = 0;
+
+    // shared by the mailboxes of the dispatcher
+    QMutex *scalersMutex = Q_NULLPTR;
+    ScalerCache *scalers = Q_NULLPTR;
+
+    QMutex mutex;
+    QWaitCondition cond;
+    QQueue<DispatchedFramePtr> frames;
+    bool closed = false;
+    // a pool task is draining the mailbox
+    bool running = false;
+    QThread *thread = Q_NULLPTR;
+
+    quint64 delivered = 0;
+    quint64 dropped = 0;
+};
+
+class MailboxThread : public QThread
+{
+public:
+    MailboxThread(FrameMailbox *mailbox) : m_mailbox(mailbox) {}
+
+protected:
+    void run() override
+    {
+        DispatchedFramePtr dispatched;
+        while (m_mailbox->take(dispatched, true)) {
+            m_mailbox->deliverNext(dispatched);
+            dispatched.clear();
+        }
+    }
+
+private:
+    FrameMailbox *m_mailbox = Q_NULLPTR;
+};
+
+class MailboxTask : public QRunnable
+{
+public:
+    MailboxTask(FrameMailbox *mailbox) : m_mailbox(mailbox) {}
+
+    void run() override
+    {
+        // drain, then give the pool thread back
+        DispatchedFramePtr dispatched;
+        while (m_mailbox->take(dispatched, false)) {
+            m_mailbox->deliverNext(dispatched);
+            dispatched.clear();
+        }
+    }
+
+private:
+    FrameMailbox *m_mailbox = Q_NULLPTR;
+};
+
+FrameRef FrameMailbox::output(DispatchedFrame &dispatched) const
+{
+    const AVFrame *frame = dispatched.source.avFrame();
+    AVPixelFormat format = AV_PIX_FMT_NONE == outputFormat ? static_cast<AVPixelFormat>(frame->format) : outputFormat;
+    int width = outputWidth;
+    int height = outputHeight;
+    ScalerCache::outputSize(frame, format, width, height);
+    if (format == frame->format && width == frame->width && height == frame->height) {
+        return dispatched.source;
+    }
+
+    QSharedPointer<ConvertedFrame> item;
+    {
+        QMutexLocker locker(&dispatched.mutex);
+        for (const QSharedPointer<ConvertedFrame> &converted : dispatched.converted) {
+            if (converted->format == format && converted->width == width && converted->height == height) {
+                item = converted;
+                break;
+            }
+        }
+        if (!item) {
+            item = QSharedPointer<ConvertedFrame>::create();
+            item->format = format;
+            item->width = width;
+            item->height = height;
+            dispatched.converted.append(item);
+        }
+    }
+    // the other outputs of this frame are converted meanwhile
+    QMutexLocker locker(&item->mutex);
+    if (!item->done) {
+        QMutexLocker scalersLocker(scalersMutex);
+        item->frame = scalers->convert(frame, format, width, height);
+        item->done = true;
+    }
+    return item->frame;
+}
+
+void FrameMailbox::deliverNext(const DispatchedFramePtr &dispatched)
+{
+    FrameRef output = this->output(*dispatched);
+    if (output.isValid()) {
+        deliver(observer, output);
+    }
+}
+
+void FrameMailbox::post(const DispatchedFramePtr &dispatched)
+{
+    QMutexLocker locker(&mutex);
+    if (closed) {
+        return;
+    }
+    if (frames.size() >= capacity) {
+        // the observer is late, the newest frame is the one that matters
+        frames.dequeue();
+        dropped++;
+    }
+    frames.enqueue(dispatched);
+    if (OD_WORKER_THREAD == delivery) {
+        cond.wakeOne();
+    } else if (!running) {
+        running = true;
+        MailboxTask *task = new MailboxTask(this);
+        task->setAutoDelete(true);
+        deliveryPool()->start(task);
+    }
+}
+
+bool FrameMailbox::take(DispatchedFramePtr &dispatched, bool wait)
+{
+    QMutexLocker locker(&mutex);
+    while (wait && frames.isEmpty() && !closed) {
+        cond.wait(&mutex);
+    }
+    if (closed || frames.isEmpty()) {
+        // the pool task is done, see close()
+        running = false;
+        cond.wakeAll();
+        return false;
+    }
+    dispatched = frames.dequeue();
+    delivered++;
+    return true;
+}
+
+void FrameMailbox::close()
+{
+    {
+        QMutexLocker locker(&mutex);
+        closed = true;
+        frames.clear();
+        cond.wakeAll();
+        // wait for the pool task to leave the observer
+        while (running) {
+            cond.wait(&mutex);
+        }
+    }
+    if (thread) {
+        thread->wait();
+        delete thread;
+        thread = Q_NULLPTR;
+    }
+}
+
+FrameDispatcher::FrameDispatcher() {}
+
+FrameDispatcher::~FrameDispatcher()
+{
+    for (FrameMailbox *mailbox : m_mailboxes) {
+        mailbox->close();
+        delete mailbox;
+    }
+}
+
+void FrameDispatcher::addObserver(DeviceObserver *observer, const ObserverOptions &options)
+{
+    removeObserver(observer);
+
+    FrameMailbox *mailbox = new FrameMailbox(observer, options, &m_scalersMutex, &m_scalers);
+    if (OD_WORKER_THREAD == mailbox->delivery) {
+        mailbox->thread = new MailboxThread(mailbox);
+        mailbox->thread->start();
+    }
+    QMutexLocker locker(&m_mutex);
+    m_mailboxes.append(mailbox);
+    m_hasAsync = m_hasAsync || OD_GUI_THREAD != mailbox->delivery;
+    m_hasGui = m_hasGui || OD_GUI_THREAD == mailbox->delivery;
+}
+
+void FrameDispatcher::removeObserver(DeviceObserver *observer)
+{
+    FrameMailbox *mailbox = Q_NULLPTR;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (int i = 0; i < m_mailboxes.size(); i++) {
+            if (m_mailboxes[i]->observer == observer) {
+                mailbox = m_mailboxes.takeAt(i);
+                break;
+            }
+        }
+        m_hasAsync = false;
+        m_hasGui = false;
+        for (FrameMailbox *item : m_mailboxes) {
+            m_hasAsync = m_hasAsync || OD_GUI_THREAD != item->delivery;
+            m_hasGui = m_hasGui || OD_GUI_THREAD == item->delivery;
+        }
+        if (!m_hasGui) {
+            m_guiFrames.clear();
+        }
+    }
+    if (!mailbox) {
+        return;
+    }
+    // outside of m_mutex, so the decoding thread is never blocked by a slow observer
+    mailbox->close();
+    delete mailbox;
+}
+
+ObserverStats FrameDispatcher::stats(DeviceObserver *observer)
+{
+    ObserverStats stats;
+    QMutexLocker locker(&m_mutex);
+    for (FrameMailbox *mailbox : m_mailboxes) {
+        if (mailbox->observer != observer) {
+            continue;
+        }
+        QMutexLocker mailboxLocker(&mailbox->mutex);
+        stats.delivered = mailbox->delivered;
+        stats.dropped = mailbox->dropped;
+        stats.mailboxDepth = mailbox->frames.size();
+        break;
+    }
+    return stats;
+}
+
+void FrameDispatcher::setGuiDepth(int depth)
+{
+    QMutexLocker locker(&m_mutex);
+    m_guiDepth = qMax(1, depth);
+}
+
+void FrameDispatcher::dispatchAsync(const AVFrame *frame)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_hasAsync && !m_hasGui) {
+        return;
+    }
+    // one reference shared by all the mailboxes, converted on their threads
+    FrameRef frameRef(frame);
+    if (!frameRef.isValid()) {
+        return;
+    }
+    DispatchedFramePtr dispatched(new DispatchedFrame(frameRef));
+    if (m_hasGui) {
+        // the frame buffer drops the oldest frames as well
+        m_guiFrames.enqueue(dispatched);
+        while (m_guiFrames.size() > m_guiDepth) {
+            m_guiFrames.dequeue();
+        }
+    }
+    for (FrameMailbox *mailbox : m_mailboxes) {
+        if (OD_GUI_THREAD != mailbox->delivery) {
+            mailbox->post(dispatched);
+        }
+    }
+}
+
+void FrameDispatcher::dispatchGui(const AVFrame *frame)
+{
+    QVector<FrameMailbox *> mailboxes;
+    DispatchedFramePtr dispatched;
+    {
+        QMutexLocker locker(&m_mutex);
+        for (FrameMailbox *mailbox : m_mailboxes) {
+            if (OD_GUI_THREAD == mailbox->delivery) {
+                mailboxes.append(mailbox);
+            }
+        }
+        // the frame buffer moves the buffers, and the queued references keep
+        // them from being reused: the same data is the same frame
+        int index = -1;
+        for (int i = 0; i < m_guiFrames.size(); i++) {
+            if (m_guiFrames[i]->source.avFrame()->data[0] == frame->data[0]) {
+                index = i;
+                break;
+            }
+        }
+        // the frames before it were dropped by the frame buffer
+        for (int i = 0; i <= index; i++) {
+            dispatched = m_guiFrames.dequeue();
+        }
+    }
+    if (mailboxes.isEmpty()) {
+        return;
+    }
+    if (!dispatched) {
+        // posted before the first GUI observer was added
+        FrameRef frameRef(frame);
+        if (!frameRef.isValid()) {
+            return;
+        }
+        dispatched = DispatchedFramePtr(new DispatchedFrame(frameRef));
+    }
+    // GUI observers are added and removed on the GUI thread, so they are still there
+    for (FrameMailbox *mailbox : mailboxes) {
+        FrameRef output = mailbox->output(*dispatched);
+        if (!output.isValid()) {
+            continue;
+        }
+        deliver(mailbox->observer, output);
+        QMutexLocker locker(&mailbox->mutex);
+        mailbox->delivered++;
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef FRAMEDISPATCHER_H
+#define FRAMEDISPATCHER_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QSharedPointer>
+#include <QVector>
+
+#include "../../../include/QtScrcpyCore.h"
+#include "scalercache.h"
+
+// forward declarations
+typedef struct AVFrame AVFrame;
+class FrameMailbox;
+struct DispatchedFrame;
+
+// Delivers the decoded frames to the observers, each with its own delivery mode:
+// OD_GUI_THREAD observers are called from the decoder's onFrame (GUI thread),
+// the others get the frames straight from the decoding thread through a bounded
+// drop-oldest mailbox, drained by a dedicated thread or by a shared pool, so a
+// slow observer delays neither the others nor the decoder.
+// The frames are converted to the format and size each observer asked for,
+// once per distinct output and frame, lazily on the delivery thread of the
+// first observer that needs it: the decoding thread only posts references.
+class FrameDispatcher
+{
+public:
+    FrameDispatcher();
+    virtual ~FrameDispatcher();
+
+    void addObserver(qsc::DeviceObserver *observer, const qsc::ObserverOptions &options);
+    // blocks until the observer is not called anymore
+    void removeObserver(qsc::DeviceObserver *observer);
+    qsc::ObserverStats stats(qsc::DeviceObserver *observer);
+
+    // frames between dispatchAsync and dispatchGui: the depth of the decoder
+    // frame buffer
+    void setGuiDepth(int depth);
+    // decoding thread: post the frame to the asynchronous observers, and keep
+    // it for the OD_GUI_THREAD ones
+    void dispatchAsync(const AVFrame *frame);
+    // GUI thread: call the OD_GUI_THREAD observers, with the conversions of the
+    // same frame already done for the asynchronous ones
+    void dispatchGui(const AVFrame *frame);
+
+private:
+    QMutex m_mutex;
+    QVector<FrameMailbox *> m_mailboxes;
+    bool m_hasAsync = false;
+    bool m_hasGui = false;
+    // posted by dispatchAsync, not given to dispatchGui yet
+    QQueue<QSharedPointer<DispatchedFrame>> m_guiFrames;
+    int m_guiDepth = 1;
+    // all the conversions of the device, SwsContexts are not thread safe
+    QMutex m_scalersMutex;
+    ScalerCache m_scalers;
+};
+
+#endif // FRAMEDISPATCHER_H
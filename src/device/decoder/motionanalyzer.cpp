@@ -0,0 +1,94 @@
+#include <cmath>
+
+#include "motionanalyzer.h"
+
+extern "C"
+{
+#include "libavutil/frame.h"
+#include "libavutil/motion_vector.h"
+}
+
+// a block moving less than that is considered static (quarter pel rounding)
+#define MOTION_MIN_PIXELS 1.0f
+
+MotionAnalyzer::MotionAnalyzer() {}
+
+MotionAnalyzer::~MotionAnalyzer() {}
+
+void MotionAnalyzer::setup(int cellSize)
+{
+    m_cellSize = qMax(16, cellSize);
+}
+
+bool MotionAnalyzer::analyze(const AVFrame *frame, qsc::MotionInfo &motion)
+{
+    if (!frame || frame->width <= 0 || frame->height <= 0) {
+        return false;
+    }
+    if (frame->key_frame || AV_PICTURE_TYPE_I == frame->pict_type) {
+        return false;
+    }
+
+    int width = frame->width;
+    int height = frame->height;
+    int cellSize = m_cellSize;
+    int columns = (width + cellSize - 1) / cellSize;
+    int rows = (height + cellSize - 1) / cellSize;
+
+    motion.pts = frame->pts;
+    motion.width = width;
+    motion.height = height;
+    motion.cellSize = cellSize;
+    motion.columns = columns;
+    motion.rows = rows;
+    motion.cells = QVector<float>(columns * rows, 0.0f);
+    m_cellArea.fill(0.0f, columns * rows);
+
+    // a P frame without vectors is fully intra coded
+    const AVFrameSideData *sideData = av_frame_get_side_data(frame, AV_FRAME_DATA_MOTION_VECTORS);
+    const AVMotionVector *vectors = sideData ? reinterpret_cast<const AVMotionVector *>(sideData->data) : Q_NULLPTR;
+    int count = sideData ? static_cast<int>(sideData->size / sizeof(AVMotionVector)) : 0;
+
+    double covered = 0;
+    double moving = 0;
+    double sumDx = 0;
+    double sumDy = 0;
+    for (int i = 0; i < count; i++) {
+        const AVMotionVector &mv = vectors[i];
+        if (mv.source > 0) {
+            // only the past reference, a bi-predicted block must not count twice
+            continue;
+        }
+        float scale = mv.motion_scale ? mv.motion_scale : 1.0f;
+        // displacement of the content: src = dst + motion
+        float dx = -mv.motion_x / scale;
+        float dy = -mv.motion_y / scale;
+        float magnitude = std::sqrt(dx * dx + dy * dy);
+        float area = static_cast<float>(mv.w) * mv.h;
+
+        int column = qBound(0, mv.dst_x / cellSize, columns - 1);
+        int row = qBound(0, mv.dst_y / cellSize, rows - 1);
+        motion.cells[row * columns + column] += magnitude * area;
+        m_cellArea[row * columns + column] += area;
+
+        covered += area;
+        if (magnitude >= MOTION_MIN_PIXELS) {
+            moving += area;
+            sumDx += dx * area;
+            sumDy += dy * area;
+        }
+    }
+
+    for (int i = 0; i < motion.cells.size(); i++) {
+        if (m_cellArea[i] > 0) {
+            motion.cells[i] /= m_cellArea[i];
+        }
+    }
+    // the coded size may be a bit bigger than the frame (1080 -> 1088)
+    double area = static_cast<double>(width) * height;
+    motion.intraRatio = static_cast<float>(qBound(0.0, 1.0 - covered / area, 1.0));
+    motion.activity = static_cast<float>(qBound(0.0, moving / area + motion.intraRatio, 1.0));
+    motion.dx = moving > 0 ? static_cast<float>(sumDx / moving) : 0.0f;
+    motion.dy = moving > 0 ? static_cast<float>(sumDy / moving) : 0.0f;
+    return true;
+}
@@ -0,0 +1,32 @@
+#ifndef MOTIONANALYZER_H
+#define MOTIONANALYZER_H
+
+#include <QMetaType>
+#include <QVector>
+
+#include "../../../include/QtScrcpyCoreDef.h"
+
+typedef struct AVFrame AVFrame;
+
+// Summarizes the H.264 motion vectors the decoder exports as frame side data
+// (AV_CODEC_EXPORT_DATA_MVS) into a coarse motion grid and an activity score.
+// The pixels are never read, the cost is one pass over the vectors.
+class MotionAnalyzer
+{
+public:
+    MotionAnalyzer();
+    virtual ~MotionAnalyzer();
+
+    void setup(int cellSize);
+    // false for the key frames, they have no vectors
+    bool analyze(const AVFrame *frame, qsc::MotionInfo &motion);
+
+private:
+    int m_cellSize = 64;
+    // block area per cell of the current frame
+    QVector<float> m_cellArea;
+};
+
+Q_DECLARE_METATYPE(qsc::MotionInfo)
+
+#endif // MOTIONANALYZER_H
@@ -0,0 +1,116 @@
+#include "scalercache.h"
+#include "yuvtorgb.h"
+
+extern "C"
+{
+#include "libavutil/pixdesc.h"
+}
+
+ScalerCache::ScalerCache(int capacity) : m_capacity(qMax(1, capacity)) {}
+
+ScalerCache::~ScalerCache()
+{
+    clear();
+}
+
+qsc::FrameRef ScalerCache::convert(const AVFrame *frame, AVPixelFormat format, int width, int height, int flags)
+{
+    if (!frame || frame->width <= 0 || frame->height <= 0) {
+        return qsc::FrameRef();
+    }
+    outputSize(frame, format, width, height);
+    if (width <= 0 || height <= 0) {
+        return qsc::FrameRef();
+    }
+
+    AVFrame *output = av_frame_alloc();
+    if (!output) {
+        return qsc::FrameRef();
+    }
+    output->width = width;
+    output->height = height;
+    output->format = format;
+    output->pts = frame->pts;
+    if (av_frame_get_buffer(output, 0) < 0 || !scale(frame, output, flags)) {
+        av_frame_free(&output);
+        return qsc::FrameRef();
+    }
+
+    qsc::FrameRef frameRef(output);
+    av_frame_free(&output);
+    return frameRef;
+}
+
+bool ScalerCache::scale(const AVFrame *frame, AVFrame *output, int flags)
+{
+    if (AV_PIX_FMT_RGB32 == output->format && frame->width == output->width && frame->height == output->height && YuvToRgb::isPreferred(frame)) {
+        // pure colorspace conversion of a big frame, faster than swscale
+        return YuvToRgb::convert(frame, output->data[0], output->linesize[0]);
+    }
+    struct SwsContext *ctx = context(frame->width, frame->height, frame->format, output->width, output->height, output->format, flags);
+    if (!ctx) {
+        return false;
+    }
+    return sws_scale(ctx, frame->data, frame->linesize, 0, frame->height, output->data, output->linesize) > 0;
+}
+
+void ScalerCache::clear()
+{
+    for (Entry &entry : m_entries) {
+        sws_freeContext(entry.ctx);
+    }
+    m_entries.clear();
+}
+
+void ScalerCache::outputSize(const AVFrame *frame, AVPixelFormat format, int &width, int &height)
+{
+    if (width <= 0 && height <= 0) {
+        width = frame->width;
+        height = frame->height;
+    } else if (width <= 0) {
+        width = static_cast<int>(static_cast<qint64>(frame->width) * height / frame->height);
+    } else if (height <= 0) {
+        height = static_cast<int>(static_cast<qint64>(frame->height) * width / frame->width);
+    }
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(format);
+    if (desc && desc->log2_chroma_w) {
+        width &= ~1;
+    }
+    if (desc && desc->log2_chroma_h) {
+        height &= ~1;
+    }
+}
+
+struct SwsContext *ScalerCache::context(int srcWidth, int srcHeight, int srcFormat, int dstWidth, int dstHeight, int dstFormat, int flags)
+{
+    m_useCounter++;
+    for (Entry &entry : m_entries) {
+        if (entry.srcWidth == srcWidth && entry.srcHeight == srcHeight && entry.srcFormat == srcFormat && entry.dstWidth == dstWidth
+            && entry.dstHeight == dstHeight && entry.dstFormat == dstFormat && entry.flags == flags) {
+            entry.lastUsed = m_useCounter;
+            return entry.ctx;
+        }
+    }
+
+    struct SwsContext *ctx = sws_getContext(srcWidth, srcHeight, static_cast<AVPixelFormat>(srcFormat), dstWidth, dstHeight,
+                                            static_cast<AVPixelFormat>(dstFormat), flags, Q_NULLPTR, Q_NULLPTR, Q_NULLPTR);
+    if (!ctx) {
+        qCritical("Could not create the scaler %dx%d -> %dx%d", srcWidth, srcHeight, dstWidth, dstHeight);
+        return Q_NULLPTR;
+    }
+
+    if (m_entries.size() >= m_capacity) {
+        // the entries of the previous orientation go first
+        int oldest = 0;
+        for (int i = 1; i < m_entries.size(); i++) {
+            if (m_entries[i].lastUsed < m_entries[oldest].lastUsed) {
+                oldest = i;
+            }
+        }
+        sws_freeContext(m_entries[oldest].ctx);
+        m_entries.remove(oldest);
+    }
+    Entry entry = { srcWidth, srcHeight, srcFormat, dstWidth, dstHeight, dstFormat, flags, m_useCounter, ctx };
+    m_entries.append(entry);
+    return ctx;
+}
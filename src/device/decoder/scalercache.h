@@ -0,0 +1,57 @@
+#ifndef SCALERCACHE_H
+#define SCALERCACHE_H
+
+#include <QVector>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+#include "libswscale/swscale.h"
+}
+
+#include "../../../include/frameref.h"
+
+// Cache of SwsContexts keyed by (src geometry, dst geometry, format, flags).
+// Same size YUV420P -> RGB32 goes through YuvToRgb where it is faster.
+// The contexts are created lazily, e.g. on the first frame after a rotation,
+// and the least recently used one is freed when the cache is full.
+// Not thread safe: one cache per converting thread.
+class ScalerCache
+{
+public:
+    ScalerCache(int capacity = 8);
+    virtual ~ScalerCache();
+
+    // convert frame into a new ref-counted frame, width/height 0 keeps the
+    // aspect ratio (both 0: source size), invalid FrameRef on error
+    qsc::FrameRef convert(const AVFrame *frame, AVPixelFormat format, int width, int height, int flags = SWS_BILINEAR);
+    // scale frame into output, whose size, format and buffers are set by the caller
+    bool scale(const AVFrame *frame, AVFrame *output, int flags = SWS_BILINEAR);
+    void clear();
+
+    // output size for the requested one, even for the chroma subsampled formats
+    static void outputSize(const AVFrame *frame, AVPixelFormat format, int &width, int &height);
+
+private:
+    struct Entry
+    {
+        int srcWidth;
+        int srcHeight;
+        int srcFormat;
+        int dstWidth;
+        int dstHeight;
+        int dstFormat;
+        int flags;
+        quint64 lastUsed;
+        struct SwsContext *ctx;
+    };
+
+    struct SwsContext *context(int srcWidth, int srcHeight, int srcFormat, int dstWidth, int dstHeight, int dstFormat, int flags);
+
+private:
+    int m_capacity = 8;
+    QVector<Entry> m_entries;
+    quint64 m_useCounter = 0;
+};
+
+#endif // SCALERCACHE_H
@@ -0,0 +1,147 @@
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "scalercache.h"
+#include "screenshotencoder.h"
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+using namespace qsc;
+
+static QThreadPool *screenshotPool()
+{
+    // shared by all the devices, a slow PNG encoding never delays the delivery pools
+    static QThreadPool pool;
+    return &pool;
+}
+
+// the contexts of the devices sizes are kept between the screenshots, the
+// conversion is short next to the encoding, so the workers take turns
+static QMutex s_scalersMutex;
+
+static ScalerCache *screenshotScalers()
+{
+    static ScalerCache scalers(4);
+    return &scalers;
+}
+
+class ScreenshotTask : public QRunnable
+{
+public:
+    ScreenshotTask(const FrameRef &frame, const ScreenshotOptions &options, const QString &filePath, QObject *context, ScreenshotEncoder::Callback callback)
+        : m_frame(frame), m_options(options), m_filePath(filePath), m_context(context), m_callback(callback)
+    {}
+
+    void run() override
+    {
+        ScreenshotResult result = ScreenshotEncoder::encode(m_frame, m_options, m_filePath);
+        // give the decoder buffer back before waiting for the GUI thread
+        m_frame.reset();
+
+        QPointer<QObject> context = m_context;
+        ScreenshotEncoder::Callback callback = m_callback;
+        QMetaObject::invokeMethod(
+            QCoreApplication::instance(),
+            [context, callback, result]() {
+                if (context && callback) {
+                    callback(result);
+                }
+            },
+            Qt::QueuedConnection);
+    }
+
+private:
+    FrameRef m_frame;
+    ScreenshotOptions m_options;
+    QString m_filePath;
+    QPointer<QObject> m_context;
+    ScreenshotEncoder::Callback m_callback;
+};
+
+void ScreenshotEncoder::encodeAsync(const FrameRef &frame, const ScreenshotOptions &options, const QString &filePath, QObject *context, Callback callback)
+{
+    screenshotPool()->start(new ScreenshotTask(frame, options, filePath, context, callback));
+}
+
+ScreenshotResult ScreenshotEncoder::encode(const FrameRef &frame, const ScreenshotOptions &options, const QString &filePath)
+{
+    ScreenshotResult result;
+    result.format = options.format;
+    if (!frame.isValid()) {
+        return result;
+    }
+
+    // convert straight into the result buffer, the raw format needs no copy
+    const AVFrame *source = frame.avFrame();
+    int width = source->width;
+    int height = source->height;
+    QByteArray rgb(width * height * 4, Qt::Uninitialized);
+    AVFrame *output = av_frame_alloc();
+    if (!output) {
+        return result;
+    }
+    output->data[0] = reinterpret_cast<uint8_t *>(rgb.data());
+    output->linesize[0] = width * 4;
+    output->width = width;
+    output->height = height;
+    output->format = AV_PIX_FMT_RGB32;
+    bool converted = false;
+    {
+        QMutexLocker locker(&s_scalersMutex);
+        converted = screenshotScalers()->scale(source, output, SWS_BICUBIC);
+    }
+    av_frame_free(&output);
+    if (!converted) {
+        qWarning("screenshot: convert frame failed");
+        return result;
+    }
+
+    if (SF_RAW_RGB32 == options.format) {
+        result.data = rgb;
+    } else {
+        QImage image(reinterpret_cast<const uchar *>(rgb.constData()), width, height, width * 4, QImage::Format_RGB32);
+        QBuffer buffer(&result.data);
+        buffer.open(QIODevice::WriteOnly);
+        if (!image.save(&buffer, SF_JPEG == options.format ? "JPG" : "PNG", options.quality)) {
+            qWarning("screenshot: encode image failed");
+            result.data.clear();
+            return result;
+        }
+    }
+    result.width = width;
+    result.height = height;
+    result.pts = frame.pts();
+    result.success = true;
+
+    if (!filePath.isEmpty()) {
+        QFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly) || file.write(result.data) != result.data.size()) {
+            qWarning() << "screenshot save failed: " << filePath;
+        } else {
+            result.filePath = filePath;
+            qInfo() << "screenshot save to " << filePath;
+        }
+    }
+    return result;
+}
+
+QString ScreenshotEncoder::fileSuffix(ScreenshotFormat format)
+{
+    switch (format) {
+    case SF_JPEG:
+        return "jpg";
+    case SF_RAW_RGB32:
+        return "rgb";
+    default:
+        return "png";
+    }
+}
@@ -0,0 +1,29 @@
+#ifndef SCREENSHOTENCODER_H
+#define SCREENSHOTENCODER_H
+
+#include <functional>
+
+#include <QPointer>
+#include <QString>
+
+#include "../../../include/QtScrcpyCoreDef.h"
+#include "../../../include/frameref.h"
+
+// Converts a frame to RGB32 and encodes it (PNG/JPEG/raw) on a shared worker
+// pool, so that neither the GUI thread nor the decoder waits for a screenshot.
+class ScreenshotEncoder
+{
+public:
+    typedef std::function<void(const qsc::ScreenshotResult &result)> Callback;
+
+    // the callback runs on the GUI thread, and not at all if context was
+    // deleted meanwhile
+    // filePath: the encoded data is also written there when not empty
+    static void encodeAsync(const qsc::FrameRef &frame, const qsc::ScreenshotOptions &options, const QString &filePath, QObject *context, Callback callback);
+    static qsc::ScreenshotResult encode(const qsc::FrameRef &frame, const qsc::ScreenshotOptions &options, const QString &filePath);
+
+    // file suffix matching the format, without the dot
+    static QString fileSuffix(qsc::ScreenshotFormat format);
+};
+
+#endif // SCREENSHOTENCODER_H
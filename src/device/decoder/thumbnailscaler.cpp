@@ -0,0 +1,20 @@
+#include "thumbnailscaler.h"
+
+ThumbnailScaler::ThumbnailScaler() {}
+
+ThumbnailScaler::~ThumbnailScaler() {}
+
+void ThumbnailScaler::setOutput(int width, AVPixelFormat format)
+{
+    m_width = width;
+    m_format = format;
+}
+
+qsc::FrameRef ThumbnailScaler::scale(const AVFrame *frame)
+{
+    if (!frame || m_width <= 0 || frame->width <= 0) {
+        return qsc::FrameRef();
+    }
+    // never upscale, bilinear is cheap and good enough at this size
+    return m_scalers.convert(frame, m_format, qMin(m_width, frame->width), 0, SWS_FAST_BILINEAR);
+}
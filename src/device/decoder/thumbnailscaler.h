@@ -0,0 +1,27 @@
+#ifndef THUMBNAILSCALER_H
+#define THUMBNAILSCALER_H
+
+#include "scalercache.h"
+
+// Downscales decoded frames to small thumbnails.
+// The scaler context is cached and only rebuilt when the source size or
+// format changes (rotation), each thumbnail is a new ref-counted frame.
+class ThumbnailScaler
+{
+public:
+    ThumbnailScaler();
+    virtual ~ThumbnailScaler();
+
+    // width of the thumbnails, the height follows the aspect ratio
+    void setOutput(int width, AVPixelFormat format);
+    // invalid FrameRef on error
+    qsc::FrameRef scale(const AVFrame *frame);
+
+private:
+    int m_width = 0;
+    AVPixelFormat m_format = AV_PIX_FMT_RGB32;
+    // one size per orientation
+    ScalerCache m_scalers{2};
+};
+
+#endif // THUMBNAILSCALER_H
@@ -1,5 +1,5 @@
 #include "videobuffer.h"
-#include "avframeconvert.h"
+#include "latencytracker.h"
 extern "C"
 {
 #include "libavformat/avformat.h"
@@ -20,14 +20,15 @@ bool VideoBuffer::init()
         goto error;
     }
 
-    m_renderingframe = av_frame_alloc();
-    if (!m_renderingframe) {
+    m_lastFrame = av_frame_alloc();
+    if (!m_lastFrame) {
         goto error;
     }
 
-    // there is initially no rendering frame, so consider it has already been
-    // consumed
-    m_renderingFrameConsumed = true;
+    m_ring.fill(Q_NULLPTR, m_depth);
+    m_ringHead = 0;
+    m_ringCount = 0;
+    m_interrupted = false;
 
     m_fpsCounter.start();
     return true;
@@ -43,26 +44,39 @@ void VideoBuffer::deInit()
         av_frame_free(&m_decodingFrame);
         m_decodingFrame = Q_NULLPTR;
     }
-    if (m_renderingframe) {
-        av_frame_free(&m_renderingframe);
-        m_renderingframe = Q_NULLPTR;
+    if (m_lastFrame) {
+        av_frame_free(&m_lastFrame);
+        m_lastFrame = Q_NULLPTR;
     }
+    for (int i = 0; i < m_ringCount; i++) {
+        av_frame_free(&m_ring[(m_ringHead + i) % m_ring.size()]);
+    }
+    m_ring.clear();
+    m_ringHead = 0;
+    m_ringCount = 0;
+    for (AVFrame *frame : m_freeFrames) {
+        av_frame_free(&frame);
+    }
+    m_freeFrames.clear();
     m_fpsCounter.stop();
 }
 
-void VideoBuffer::lock()
+void VideoBuffer::setPolicy(Policy policy, int depth)
 {
-    m_mutex.lock();
+    m_policy = policy;
+    m_depth = POLICY_LATEST == policy ? 1 : qMax(1, depth);
 }
 
-void VideoBuffer::unLock()
+void VideoBuffer::setRenderExpiredFrames(bool renderExpiredFrames)
 {
-    m_mutex.unlock();
+    if (renderExpiredFrames) {
+        setPolicy(POLICY_BLOCK, m_depth);
+    }
 }
 
-void VideoBuffer::setRenderExpiredFrames(bool renderExpiredFrames)
+void VideoBuffer::setLatencyTracker(LatencyTracker *latencyTracker)
 {
-    m_renderExpiredFrames = renderExpiredFrames;
+    m_latencyTracker = latencyTracker;
 }
 
 AVFrame *VideoBuffer::decodingFrame()
@@ -70,105 +84,107 @@ AVFrame *VideoBuffer::decodingFrame()
     return m_decodingFrame;
 }
 
-void VideoBuffer::offerDecodedFrame(bool &previousFrameSkipped)
+void VideoBuffer::offerDecodedFrame(bool &needNotify)
 {
-    m_mutex.lock();
-
-    if (m_renderExpiredFrames) {
-        // if m_renderExpiredFrames is enable, then the decoder must wait for the current
-        // frame to be consumed
-        while (!m_renderingFrameConsumed && !m_interrupted) {
-            m_renderingFrameConsumedCond.wait(&m_mutex);
+    QMutexLocker locker(&m_mutex);
+    needNotify = false;
+    // a non empty ring means a notification is still pending, a dropped frame
+    // must not trigger another one (a slow consumer would get one per frame)
+    bool wasEmpty = false;
+
+    if (POLICY_BLOCK == m_policy) {
+        // the decoder must wait for a frame to be taken
+        while (m_ringCount == m_ring.size() && !m_interrupted) {
+            m_slotFreeCond.wait(&m_mutex);
         }
-    } else {
-        if (m_fpsCounter.isStarted() && !m_renderingFrameConsumed) {
+        if (m_interrupted) {
+            av_frame_unref(m_decodingFrame);
+            return;
+        }
+        wasEmpty = !m_ringCount;
+    } else if (m_ringCount == m_ring.size()) {
+        // drop the oldest frame, its shell takes the new one
+        AVFrame *oldest = m_ring[m_ringHead];
+        av_frame_unref(oldest);
+        m_freeFrames.append(oldest);
+        m_ringHead = (m_ringHead + 1) % m_ring.size();
+        m_ringCount--;
+        if (m_fpsCounter.isStarted()) {
             m_fpsCounter.addSkippedFrame();
         }
+    } else {
+        wasEmpty = !m_ringCount;
     }
 
-    swap();
-    previousFrameSkipped = !m_renderingFrameConsumed;
-    m_renderingFrameConsumed = false;
-    m_mutex.unlock();
+    AVFrame *frame = allocFrame();
+    if (!frame) {
+        av_frame_unref(m_decodingFrame);
+        return;
+    }
+    av_frame_move_ref(frame, m_decodingFrame);
+    if (m_latencyTracker) {
+        m_latencyTracker->mark(LatencyTracker::STAGE_OFFER, frame->pts);
+    }
+    m_ring[(m_ringHead + m_ringCount) % m_ring.size()] = frame;
+    needNotify = wasEmpty;
+    m_ringCount++;
 }
 
-const AVFrame *VideoBuffer::consumeRenderedFrame()
+AVFrame *VideoBuffer::takeFrame()
 {
-    Q_ASSERT(!m_renderingFrameConsumed);
-    m_renderingFrameConsumed = true;
+    QMutexLocker locker(&m_mutex);
+    if (!m_ringCount) {
+        return Q_NULLPTR;
+    }
+    AVFrame *frame = m_ring[m_ringHead];
+    m_ring[m_ringHead] = Q_NULLPTR;
+    m_ringHead = (m_ringHead + 1) % m_ring.size();
+    m_ringCount--;
+
+    av_frame_unref(m_lastFrame);
+    av_frame_ref(m_lastFrame, frame);
+
     if (m_fpsCounter.isStarted()) {
         m_fpsCounter.addRenderedFrame();
     }
-    if (m_renderExpiredFrames) {
-        // if m_renderExpiredFrames is enable, then notify the decoder the current frame is
-        // consumed, so that it may push a new one
-        m_renderingFrameConsumedCond.wakeOne();
+    if (POLICY_BLOCK == m_policy) {
+        m_slotFreeCond.wakeOne();
     }
-    return m_renderingframe;
+    return frame;
 }
 
-void VideoBuffer::peekRenderedFrame(std::function<void(int width, int height, uint8_t* dataRGB32)> onFrame)
+void VideoBuffer::releaseFrame(AVFrame *frame)
 {
-    if (!onFrame) {
-        return;
-    }
-
-    lock();
-    auto frame = m_renderingframe;
-    int width = frame->width;
-    int height = frame->height;
-    int linesize = frame->linesize[0];
-
-    // create buffer
-    uint8_t* rgbBuffer = new uint8_t[linesize * height * 4];
-    AVFrame *rgbFrame = av_frame_alloc();
-    if (!rgbFrame) {
-        delete [] rgbBuffer;
-        return;
-    }
-
-    // bind buffer to AVFrame
-    av_image_fill_arrays(rgbFrame->data, rgbFrame->linesize, rgbBuffer, AV_PIX_FMT_RGB32, width, height, 4);
-
-    // convert
-    AVFrameConvert convert;
-    convert.setSrcFrameInfo(width, height, AV_PIX_FMT_YUV420P);
-    convert.setDstFrameInfo(width, height, AV_PIX_FMT_RGB32);
-    bool ret = false;
-    ret = convert.init();
-    if (!ret) {
-        delete [] rgbBuffer;
-        av_free(rgbFrame);
+    if (!frame) {
         return;
     }
-    ret = convert.convert(frame, rgbFrame);
-    if (!ret) {
-        delete [] rgbBuffer;
-        av_free(rgbFrame);
-        return;
-    }
-    convert.deInit();
-    av_free(rgbFrame);
-    unLock();
+    // unref outside of the lock, it may free the buffers
+    av_frame_unref(frame);
+    QMutexLocker locker(&m_mutex);
+    m_freeFrames.append(frame);
+}
 
-    onFrame(width, height, rgbBuffer);
-    delete [] rgbBuffer;
+qsc::FrameRef VideoBuffer::lastFrame()
+{
+    // only a reference is taken under the lock, the caller converts it at will
+    QMutexLocker locker(&m_mutex);
+    return qsc::FrameRef(m_lastFrame);
 }
 
 void VideoBuffer::interrupt()
 {
-    if (m_renderExpiredFrames) {
-        m_mutex.lock();
-        m_interrupted = true;
-        m_mutex.unlock();
-        // wake up blocking wait
-        m_renderingFrameConsumedCond.wakeOne();
-    }
+    m_mutex.lock();
+    m_interrupted = true;
+    m_mutex.unlock();
+    // wake up blocking wait
+    m_slotFreeCond.wakeAll();
 }
 
-void VideoBuffer::swap()
+AVFrame *VideoBuffer::allocFrame()
 {
-    AVFrame *tmp = m_decodingFrame;
-    m_decodingFrame = m_renderingframe;
-    m_renderingframe = tmp;
+    // called with m_mutex locked
+    if (!m_freeFrames.isEmpty()) {
+        return m_freeFrames.takeLast();
+    }
+    return av_frame_alloc();
 }
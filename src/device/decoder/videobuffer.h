@@ -2,41 +2,60 @@
 #define VIDEO_BUFFER_H
 
 #include <QMutex>
+#include <QVector>
 #include <QWaitCondition>
 #include <QObject>
 
 #include <functional>
 #include "fpscounter.h"
+#include "../../../include/frameref.h"
 
 // forward declarations
 typedef struct AVFrame AVFrame;
+class LatencyTracker;
 
+// Ring of decoded frames between the decoder and the consumers.
+// The frames only hold references to the decoder's ref-counted buffers, so a
+// consumer may keep a taken frame as long as it wants without blocking the
+// decoder, which simply decodes into new buffers meanwhile.
+// The AVFrame shells are recycled through a small pool.
 class VideoBuffer : public QObject
 {
     Q_OBJECT
 public:
+    enum Policy
+    {
+        POLICY_LATEST = 0, // keep only the newest frame
+        POLICY_FIFO,       // keep up to depth frames, drop the oldest when full
+        POLICY_BLOCK,      // keep up to depth frames, the decoder waits when full
+    };
+
     VideoBuffer(QObject *parent = Q_NULLPTR);
     virtual ~VideoBuffer();
 
     bool init();
     void deInit();
-    void lock();
-    void unLock();
+    // must be called before init()
+    void setPolicy(Policy policy, int depth);
     void setRenderExpiredFrames(bool renderExpiredFrames);
+    void setLatencyTracker(LatencyTracker *latencyTracker);
 
+    // the frame the decoder decodes into
     AVFrame *decodingFrame();
-    // set the decoder frame as ready for rendering
-    // this function locks m_mutex during its execution
-    // returns true if the previous frame had been consumed
-    void offerDecodedFrame(bool &previousFrameSkipped);
+    // move the decoding frame into the ring
+    // this function locks m_mutex during its execution, and may wait for a free
+    // slot with POLICY_BLOCK
+    // needNotify is true if the ring was empty before this frame (a dropped
+    // frame does not count), so the consumer must be notified
+    void offerDecodedFrame(bool &needNotify);
 
-    // mark the rendering frame as consumed and return it
-    // MUST be called with m_mutex locked!!!
-    // the caller is expected to render the returned frame to some texture before
-    // unlocking m_mutex
-    const AVFrame *consumeRenderedFrame();
+    // take the oldest frame out of the ring, Q_NULLPTR if empty
+    // the frame must be given back with releaseFrame(), from any thread
+    AVFrame *takeFrame();
+    void releaseFrame(AVFrame *frame);
 
-    void peekRenderedFrame(std::function<void(int width, int height, uint8_t* dataRGB32)> onFrame);
+    // reference to the last taken frame, invalid if none yet
+    qsc::FrameRef lastFrame();
 
     // wake up and avoid any blocking call
     void interrupt();
@@ -45,21 +64,29 @@ signals:
     void updateFPS(quint32 fps);
 
 private:
-    void swap();
+    AVFrame *allocFrame();
 
 private:
+    Policy m_policy = POLICY_LATEST;
+    int m_depth = 1;
+
     AVFrame *m_decodingFrame = Q_NULLPTR;
-    AVFrame *m_renderingframe = Q_NULLPTR;
+    // ring of pending frames, m_ringHead is the oldest one
+    QVector<AVFrame *> m_ring;
+    int m_ringHead = 0;
+    int m_ringCount = 0;
+    // released frame shells
+    QVector<AVFrame *> m_freeFrames;
+    // reference to the last taken frame, for lastFrame()
+    AVFrame *m_lastFrame = Q_NULLPTR;
+
     QMutex m_mutex;
-    bool m_renderingFrameConsumed = true;
+    QWaitCondition m_slotFreeCond;
     FpsCounter m_fpsCounter;
 
-    bool m_renderExpiredFrames = false;
-    QWaitCondition m_renderingFrameConsumedCond;
-
-    // interrupted is not used if expired frames are not rendered
-    // since offering a frame will never block
     bool m_interrupted = false;
+
+    LatencyTracker *m_latencyTracker = Q_NULLPTR;
 };
 
 #endif // VIDEO_BUFFER_H
@@ -0,0 +1,49 @@
+#ifndef YUVTORGB_H
+#define YUVTORGB_H
+
+#include <QtGlobal>
+
+extern "C"
+{
+#include "libavutil/frame.h"
+}
+
+// Same size YUV420P -> RGB32 (AV_PIX_FMT_RGB32, QImage::Format_RGB32) conversion:
+// SSE2/AVX2 on x86, NEON on arm64 and a scalar fallback, all bit exact with each
+// other. The coefficients follow the colorspace (BT.601/BT.709) and range
+// (limited/full) of the frame.
+// swscale has its own SIMD path for this conversion, isPreferred() tells where
+// these kernels are measurably faster (tools/bench/yuvtorgbbench.cpp).
+class YuvToRgb
+{
+public:
+    enum ColorSpace
+    {
+        COLOR_SPACE_BT601 = 0,
+        COLOR_SPACE_BT709,
+    };
+
+    enum Kernel
+    {
+        KERNEL_AUTO = 0, // best supported one
+        KERNEL_SCALAR,
+        KERNEL_SSE2,
+        KERNEL_AVX2,
+        KERNEL_NEON,
+    };
+
+    // true if frame can be converted (YUV420P, even size not required)
+    static bool isSupported(const AVFrame *frame);
+    // true if convert() beats sws_scale for frame, otherwise swscale should be used
+    static bool isPreferred(const AVFrame *frame);
+    // dst must hold frame->height rows of dstLinesize bytes
+    // threads: rows are split across a shared thread pool, 0 for auto (4K frames)
+    static bool convert(const AVFrame *frame, uint8_t *dst, int dstLinesize, int threads = 0);
+    static bool convert(const AVFrame *frame, uint8_t *dst, int dstLinesize, ColorSpace colorSpace, bool fullRange, int threads, Kernel kernel);
+
+    // for benchmarks/tests
+    static bool isKernelSupported(Kernel kernel);
+    static const char *kernelName(Kernel kernel);
+};
+
+#endif // YUVTORGB_H
@@ -1,24 +1,27 @@
 #include <QDebug>
 #include <QTime>
 
+#ifndef Q_OS_WIN
+#include <unistd.h>
+#endif
+
 #include "compat.h"
 #include "demuxer.h"
+#include "latencytracker.h"
+#include "streamcapture.h"
+#include "streamreplay.h"
 #include "videosocket.h"
 
-#define HEADER_SIZE 12
-
-#define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
-#define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
-
-#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
-
 typedef qint32 (*ReadPacketFunc)(void *, quint8 *, qint32);
 
 Demuxer::Demuxer(QObject *parent)
     : QThread(parent)
 {}
 
-Demuxer::~Demuxer() {}
+Demuxer::~Demuxer()
+{
+    releaseCapture();
+}
 
 static void avLogCallback(void *avcl, int level, const char *fmt, va_list vl)
 {
@@ -67,17 +70,62 @@ void Demuxer::deInit()
     avformat_network_deinit(); // ignore failure
 }
 
+AVCodecID Demuxer::toAVCodecId(quint32 scCodecId)
+{
+    switch (scCodecId) {
+    case SC_CODEC_ID_H264:
+        return AV_CODEC_ID_H264;
+    case SC_CODEC_ID_H265:
+        return AV_CODEC_ID_HEVC;
+    case SC_CODEC_ID_AV1:
+        return AV_CODEC_ID_AV1;
+    default:
+        return AV_CODEC_ID_NONE;
+    }
+}
+
+void Demuxer::setNativeIngest(bool nativeIngest)
+{
+    if (nativeIngest && !IngestEngine::isSupported()) {
+        qWarning("native ingest is not supported on this platform, use demuxer thread");
+        nativeIngest = false;
+    }
+    m_nativeIngest = nativeIngest;
+}
+
 void Demuxer::installVideoSocket(VideoSocket *videoSocket)
 {
-    videoSocket->moveToThread(this);
+    if (!m_nativeIngest) {
+        videoSocket->moveToThread(this);
+    }
     m_videoSocket = videoSocket;
 }
 
+void Demuxer::installReplaySource(StreamReplay *streamReplay)
+{
+    m_streamReplay = streamReplay;
+}
+
+void Demuxer::installStreamCapture(StreamCapture *streamCapture)
+{
+    m_streamCapture = streamCapture;
+}
+
 void Demuxer::setFrameSize(const QSize &frameSize)
 {
     m_frameSize = frameSize;
 }
 
+void Demuxer::setCodecId(AVCodecID codecId)
+{
+    m_codecId = codecId;
+}
+
+void Demuxer::setLatencyTracker(LatencyTracker *latencyTracker)
+{
+    m_latencyTracker = latencyTracker;
+}
+
 static quint32 bufferRead32be(quint8 *buf)
 {
     return static_cast<quint32>((buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3]);
@@ -90,8 +138,25 @@ static quint64 bufferRead64be(quint8 *buf)
     return (static_cast<quint64>(msb) << 32) | lsb;
 }
 
+static void bufferWrite32be(quint8 *buf, quint32 value)
+{
+    buf[0] = value >> 24;
+    buf[1] = (value >> 16) & 0xff;
+    buf[2] = (value >> 8) & 0xff;
+    buf[3] = value & 0xff;
+}
+
+static void bufferWrite64be(quint8 *buf, quint64 value)
+{
+    bufferWrite32be(buf, value >> 32);
+    bufferWrite32be(&buf[4], static_cast<quint32>(value));
+}
+
 qint32 Demuxer::recvData(quint8 *buf, qint32 bufSize)
 {
+    if (m_streamReplay) {
+        return m_streamReplay->recvData(buf, bufSize);
+    }
     if (!buf || !m_videoSocket) {
         return 0;
     }
@@ -102,53 +167,108 @@ qint32 Demuxer::recvData(quint8 *buf, qint32 bufSize)
 
 bool Demuxer::startDecode()
 {
+    if (m_streamReplay) {
+        start();
+        return true;
+    }
     if (!m_videoSocket) {
         return false;
     }
+    if (m_nativeIngest) {
+        return startNativeIngest();
+    }
     start();
     return true;
 }
 
 void Demuxer::stopDecode()
 {
+    if (-1 != m_ingestStreamId) {
+        // once removed, no more packet is pushed from the io threads
+        IngestEngine::instance().removeStream(m_ingestStreamId);
+        m_ingestStreamId = -1;
+        if (m_pending) {
+            av_packet_free(&m_pending);
+        }
+        m_packetPool.deInit();
+        releaseCapture();
+        return;
+    }
+    if (m_streamReplay) {
+        m_streamReplay->interrupt();
+    }
     wait();
+    releaseCapture();
 }
 
-void Demuxer::run()
+void Demuxer::releaseCapture()
 {
-    m_codecCtx = Q_NULLPTR;
-    m_parser = Q_NULLPTR;
-    AVPacket *packet = Q_NULLPTR;
-
-    // codec
-    const AVCodec* codec = avcodec_find_decoder(AV_CODEC_ID_H264);
-    if (!codec) {
-        qCritical("H.264 decoder not found");
-        goto runQuit;
+    if (m_streamCapture) {
+        delete m_streamCapture;
+        m_streamCapture = Q_NULLPTR;
+    }
+    if (m_streamReplay) {
+        delete m_streamReplay;
+        m_streamReplay = Q_NULLPTR;
     }
+}
 
-    // codeCtx
-    m_codecCtx = avcodec_alloc_context3(codec);
-    if (!m_codecCtx) {
-        qCritical("Could not allocate codec context");
-        goto runQuit;
+bool Demuxer::startNativeIngest()
+{
+    // the io threads get their own descriptor, the qt socket is released right away
+    QByteArray buffered = m_videoSocket->readAll();
+#ifdef Q_OS_WIN
+    int fd = -1;
+#else
+    int fd = dup(static_cast<int>(m_videoSocket->socketDescriptor()));
+#endif
+    m_videoSocket->close();
+    delete m_videoSocket;
+    m_videoSocket = Q_NULLPTR;
+
+    if (-1 != fd) {
+        m_ingestStreamId = IngestEngine::instance().addStream(fd, buffered, this);
+        if (-1 == m_ingestStreamId) {
+#ifndef Q_OS_WIN
+            ::close(fd);
+#endif
+        }
+    }
+    if (-1 == m_ingestStreamId) {
+        qCritical("Could not start native ingest");
+        return false;
     }
-    m_codecCtx->flags |= AV_CODEC_FLAG_LOW_DELAY;
-    m_codecCtx->width = m_frameSize.width();
-    m_codecCtx->height = m_frameSize.height();
-    m_codecCtx->pix_fmt = AV_PIX_FMT_YUV420P;
+    return true;
+}
 
-    m_parser = av_parser_init(AV_CODEC_ID_H264);
-    if (!m_parser) {
-        qCritical("Could not initialize parser");
-        goto runQuit;
+bool Demuxer::onIngestPacket(AVPacket *packet)
+{
+    if (m_latencyTracker) {
+        m_latencyTracker->mark(LatencyTracker::STAGE_RECV, packet->pts);
+    }
+    if (m_streamCapture) {
+        // the io threads already consumed the meta header, rebuild it
+        quint8 header[HEADER_SIZE];
+        quint64 ptsFlags = AV_NOPTS_VALUE == packet->pts ? SC_PACKET_FLAG_CONFIG : static_cast<quint64>(packet->pts);
+        if (packet->flags & AV_PKT_FLAG_KEY) {
+            ptsFlags |= SC_PACKET_FLAG_KEY_FRAME;
+        }
+        bufferWrite64be(header, ptsFlags);
+        bufferWrite32be(&header[8], static_cast<quint32>(packet->size));
+        m_streamCapture->writeRecord(header, HEADER_SIZE, packet->data, packet->size);
     }
+    return pushPacket(packet);
+}
 
-    // We must only pass complete frames to av_parser_parse2()!
-    // It's more complicated, but this allows to reduce the latency by 1 frame!
-    m_parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+void Demuxer::onIngestStop()
+{
+    qDebug("End of frames");
+    emit onStreamStop();
+}
 
-    packet = av_packet_alloc();
+void Demuxer::run()
+{
+    AVPacket *packet = av_packet_alloc();
     if (!packet) {
         qCritical("OOM");
         goto runQuit;
@@ -177,12 +297,8 @@ void Demuxer::run()
 
     av_packet_free(&packet);
 
-    av_parser_close(m_parser);
-
 runQuit:
-    if (m_codecCtx) {
-        avcodec_free_context(&m_codecCtx);
-    }
+    m_packetPool.deInit();
 
     if (m_videoSocket) {
         m_videoSocket->close();
@@ -226,7 +342,8 @@ bool Demuxer::recvPacket(AVPacket *packet)
     quint32 len = bufferRead32be(&header[8]);
     Q_ASSERT(len);
 
-    if (av_new_packet(packet, static_cast<int>(len))) {
+    // the payload is read straight into a recycled buffer
+    if (!m_packetPool.allocPacket(packet, static_cast<int>(len))) {
         qCritical("Could not allocate packet");
         return false;
     }
@@ -248,6 +365,13 @@ bool Demuxer::recvPacket(AVPacket *packet)
     }
 
     packet->dts = packet->pts;
+
+    if (m_latencyTracker) {
+        m_latencyTracker->mark(LatencyTracker::STAGE_RECV, packet->pts);
+    }
+    if (m_streamCapture) {
+        m_streamCapture->writeRecord(header, HEADER_SIZE, packet->data, packet->size);
+    }
     return true;
 }
 
@@ -316,22 +440,20 @@ bool Demuxer::processConfigPacket(AVPacket *packet)
 
 bool Demuxer::parse(AVPacket *packet)
 {
-    quint8 *inData = packet->data;
-    int inLen = packet->size;
-    quint8 *outData = Q_NULLPTR;
-    int outLen = 0;
-    int r = av_parser_parse2(m_parser, m_codecCtx, &outData, &outLen, inData, inLen, AV_NOPTS_VALUE, AV_NOPTS_VALUE, -1);
-
-    // PARSER_FLAG_COMPLETE_FRAMES is set
-    Q_ASSERT(r == inLen);
-    (void)r;
-    Q_ASSERT(outLen == inLen);
-
-    if (m_parser->key_frame == 1) {
+    // the server already flags key frames, only the nal unit types are needed here,
+    // no parser/codec context required
+    NalInfo nalInfo;
+    if (AV_CODEC_ID_H264 == m_codecId) {
+        nalInfo = NalScanner::scanH264(packet->data, packet->size);
+    } else if (AV_CODEC_ID_HEVC == m_codecId) {
+        nalInfo = NalScanner::scanH265(packet->data, packet->size);
+    }
+    // av1 is made of obus, not nal units: rely on the server key frame flag
+    if (nalInfo.keyFrame) {
         packet->flags |= AV_PKT_FLAG_KEY;
     }
 
-    bool ok = processFrame(packet);
+    bool ok = processFrame(packet, nalInfo);
     if (!ok) {
         qCritical("Could not process frame");
         return false;
@@ -340,9 +462,9 @@ bool Demuxer::parse(AVPacket *packet)
     return true;
 }
 
-bool Demuxer::processFrame(AVPacket *packet)
+bool Demuxer::processFrame(AVPacket *packet, const NalInfo &nalInfo)
 {
     packet->dts = packet->pts;
-    emit getFrame(packet);
+    emit getFrame(packet, nalInfo);
     return true;
 }
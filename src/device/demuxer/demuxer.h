@@ -11,8 +11,27 @@ extern "C"
 #include "libavformat/avformat.h"
 }
 
+#include "ingestengine.h"
+#include "nalscanner.h"
+#include "packetpool.h"
+
+#define HEADER_SIZE 12
+
+#define SC_PACKET_FLAG_CONFIG    (UINT64_C(1) << 63)
+#define SC_PACKET_FLAG_KEY_FRAME (UINT64_C(1) << 62)
+
+#define SC_PACKET_PTS_MASK (SC_PACKET_FLAG_KEY_FRAME - 1)
+
+// codec ids of the device info header
+#define SC_CODEC_ID_H264 UINT32_C(0x68323634) // "h264"
+#define SC_CODEC_ID_H265 UINT32_C(0x68323635) // "h265"
+#define SC_CODEC_ID_AV1  UINT32_C(0x00617631) // "av1"
+
 class VideoSocket;
-class Demuxer : public QThread
+class LatencyTracker;
+class StreamCapture;
+class StreamReplay;
+class Demuxer : public QThread, public IngestEngine::Sink
 {
     Q_OBJECT
 public:
@@ -22,32 +41,50 @@ public:
 public:
     static bool init();
     static void deInit();
+    // AV_CODEC_ID_NONE if unknown
+    static AVCodecID toAVCodecId(quint32 scCodecId);
 
+    // must be set before installVideoSocket()
+    void setNativeIngest(bool nativeIngest);
     void installVideoSocket(VideoSocket* videoSocket);
+    // read packets from a capture file instead of the video socket, takes ownership
+    void installReplaySource(StreamReplay *streamReplay);
+    // tee received packets to an opened capture file, takes ownership
+    void installStreamCapture(StreamCapture *streamCapture);
     void setFrameSize(const QSize &frameSize);
+    void setCodecId(AVCodecID codecId);
+    void setLatencyTracker(LatencyTracker *latencyTracker);
     bool startDecode();
     void stopDecode();
 
 signals:
     void onStreamStop();
-    void getFrame(AVPacket* packet);
+    void getFrame(AVPacket* packet, const NalInfo &nalInfo);
     void getConfigFrame(AVPacket* packet);
 
 protected:
     void run();
+    bool onIngestPacket(AVPacket *packet) override;
+    void onIngestStop() override;
+    bool startNativeIngest();
     bool recvPacket(AVPacket *packet);
     bool pushPacket(AVPacket *packet);
     bool processConfigPacket(AVPacket *packet);
     bool parse(AVPacket *packet);
-    bool processFrame(AVPacket *packet);
+    bool processFrame(AVPacket *packet, const NalInfo &nalInfo);
     qint32 recvData(quint8 *buf, qint32 bufSize);
+    void releaseCapture();
 
 private:
     QPointer<VideoSocket> m_videoSocket;
+    StreamReplay *m_streamReplay = Q_NULLPTR;
+    StreamCapture *m_streamCapture = Q_NULLPTR;
     QSize m_frameSize;
-
-    AVCodecContext *m_codecCtx = Q_NULLPTR;
-    AVCodecParserContext *m_parser = Q_NULLPTR;
+    AVCodecID m_codecId = AV_CODEC_ID_H264;
+    PacketPool m_packetPool;
+    LatencyTracker *m_latencyTracker = Q_NULLPTR;
+    bool m_nativeIngest = false;
+    int m_ingestStreamId = -1;
     // successive packets may need to be concatenated, until a non-config
     // packet is available
     AVPacket* m_pending = Q_NULLPTR;
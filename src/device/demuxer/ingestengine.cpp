@@ -0,0 +1,517 @@
+#include <climits>
+#include <cstring>
+#include <QDebug>
+#include <QMutexLocker>
+#include <QWaitCondition>
+
+#include "demuxer.h"
+#include "ingestengine.h"
+#include "packetpool.h"
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+// events fetched per epoll_wait
+#define INGEST_MAX_EVENTS 64
+// bytes read from one stream per wakeup, so that a busy stream cannot starve the others
+#define INGEST_READ_BUDGET (512 * 1024)
+#define INGEST_MAX_WORKERS 8
+#define INGEST_WAKE_ID UINT64_MAX
+
+struct IngestStream
+{
+    int id = -1;
+    int fd = -1;
+    IngestEngine::Sink *sink = Q_NULLPTR;
+    bool stopped = false;
+    // the io thread is reading it, the sink calls are made without the worker lock
+    bool busy = false;
+    // bytes qt read along with the device info, they belong to the first
+    // packets: the io thread parses them before its first recv()
+    QByteArray pending;
+
+    // incremental parser state, see Demuxer::recvPacket() for the framing
+    quint8 header[HEADER_SIZE];
+    int headerLen = 0;
+    quint64 ptsFlags = 0;
+    AVPacket *packet = Q_NULLPTR;
+    int payloadLen = 0;
+    bool inPayload = false;
+    PacketPool pool;
+};
+
+// the parsing runs on the io threads only
+#ifdef Q_OS_LINUX
+
+static quint32 bufferRead32be(const quint8 *buf)
+{
+    return static_cast<quint32>((buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3]);
+}
+
+static quint64 bufferRead64be(const quint8 *buf)
+{
+    quint32 msb = bufferRead32be(buf);
+    quint32 lsb = bufferRead32be(&buf[4]);
+    return (static_cast<quint64>(msb) << 32) | lsb;
+}
+
+// where the next bytes of the stream go, and how many are expected
+static quint8 *streamNextBuffer(IngestStream *stream, int &wanted)
+{
+    if (stream->inPayload) {
+        wanted = stream->packet->size - stream->payloadLen;
+        return stream->packet->data + stream->payloadLen;
+    }
+    wanted = HEADER_SIZE - stream->headerLen;
+    return stream->header + stream->headerLen;
+}
+
+static bool streamDeliver(IngestStream *stream)
+{
+    AVPacket *packet = stream->packet;
+    if (stream->ptsFlags & SC_PACKET_FLAG_CONFIG) {
+        packet->pts = AV_NOPTS_VALUE;
+    } else {
+        packet->pts = stream->ptsFlags & SC_PACKET_PTS_MASK;
+    }
+    if (stream->ptsFlags & SC_PACKET_FLAG_KEY_FRAME) {
+        packet->flags |= AV_PKT_FLAG_KEY;
+    }
+    packet->dts = packet->pts;
+
+    bool ok = stream->sink->onIngestPacket(packet);
+    av_packet_unref(packet);
+    stream->inPayload = false;
+    stream->headerLen = 0;
+    stream->payloadLen = 0;
+    return ok;
+}
+
+// account len bytes written at streamNextBuffer()
+static bool streamCommit(IngestStream *stream, int len)
+{
+    if (stream->inPayload) {
+        stream->payloadLen += len;
+        if (stream->payloadLen < stream->packet->size) {
+            return true;
+        }
+        return streamDeliver(stream);
+    }
+
+    stream->headerLen += len;
+    if (stream->headerLen < HEADER_SIZE) {
+        return true;
+    }
+
+    stream->ptsFlags = bufferRead64be(stream->header);
+    quint32 packetLen = bufferRead32be(&stream->header[8]);
+    if (packetLen > INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE) {
+        qCritical("Invalid packet size: %u", packetLen);
+        return false;
+    }
+    if (!stream->pool.allocPacket(stream->packet, static_cast<int>(packetLen))) {
+        qCritical("Could not allocate packet");
+        return false;
+    }
+    stream->inPayload = true;
+    stream->payloadLen = 0;
+    if (0 == packetLen) {
+        return streamDeliver(stream);
+    }
+    return true;
+}
+
+static bool streamFeed(IngestStream *stream, const QByteArray &data)
+{
+    int offset = 0;
+    while (offset < data.size()) {
+        int wanted = 0;
+        quint8 *buf = streamNextBuffer(stream, wanted);
+        int len = qMin(wanted, data.size() - offset);
+        memcpy(buf, data.constData() + offset, static_cast<size_t>(len));
+        offset += len;
+        if (!streamCommit(stream, len)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+class IngestWorker : public QThread
+{
+public:
+    IngestWorker() {}
+    virtual ~IngestWorker()
+    {
+        stopWorker();
+        if (-1 != m_epollFd) {
+            ::close(m_epollFd);
+        }
+        if (-1 != m_wakeFd) {
+            ::close(m_wakeFd);
+        }
+    }
+
+    bool init()
+    {
+        m_epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (-1 == m_epollFd) {
+            qCritical("Could not create epoll instance: %d", errno);
+            return false;
+        }
+        m_wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (-1 == m_wakeFd) {
+            qCritical("Could not create eventfd: %d", errno);
+            return false;
+        }
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.u64 = INGEST_WAKE_ID;
+        return 0 == epoll_ctl(m_epollFd, EPOLL_CTL_ADD, m_wakeFd, &ev);
+    }
+
+    bool addStream(IngestStream *stream)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_streams.insert(stream->id, stream);
+
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLRDHUP;
+        ev.data.u64 = static_cast<quint64>(stream->id);
+        if (epoll_ctl(m_epollFd, EPOLL_CTL_ADD, stream->fd, &ev)) {
+            qCritical("Could not watch video socket: %d", errno);
+            m_streams.remove(stream->id);
+            return false;
+        }
+        if (!stream->pending.isEmpty()) {
+            // the socket may stay silent, e.g. a static screen
+            m_pendingStreams.append(stream->id);
+            wake();
+        }
+        return true;
+    }
+
+    IngestStream *takeStream(int streamId)
+    {
+        // waits for the stream being read, sinks are not called afterwards
+        QMutexLocker locker(&m_mutex);
+        IngestStream *stream = m_streams.take(streamId);
+        while (stream && stream->busy) {
+            m_idleCond.wait(&m_mutex);
+        }
+        if (stream && !stream->stopped) {
+            epoll_ctl(m_epollFd, EPOLL_CTL_DEL, stream->fd, Q_NULLPTR);
+        }
+        return stream;
+    }
+
+    int streamCount()
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_streams.size();
+    }
+
+    void stopWorker()
+    {
+        if (!isRunning()) {
+            return;
+        }
+        m_mutex.lock();
+        m_quit = true;
+        m_mutex.unlock();
+        wake();
+        wait();
+    }
+
+protected:
+    void run() override
+    {
+        struct epoll_event events[INGEST_MAX_EVENTS];
+        for (;;) {
+            int n = epoll_wait(m_epollFd, events, INGEST_MAX_EVENTS, -1);
+            if (n < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                qCritical("epoll_wait failed: %d", errno);
+                break;
+            }
+
+            if (isQuit()) {
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                if (INGEST_WAKE_ID == events[i].data.u64) {
+                    quint64 value;
+                    while (::read(m_wakeFd, &value, sizeof(value)) > 0) {}
+                    feedPendingStreams();
+                    continue;
+                }
+                processStream(static_cast<int>(events[i].data.u64));
+            }
+        }
+        qDebug("Ingest worker ended");
+    }
+
+private:
+    // thread safe
+    void wake()
+    {
+        quint64 one = 1;
+        if (::write(m_wakeFd, &one, sizeof(one)) < 0) {
+            qWarning("Could not wake up ingest worker: %d", errno);
+        }
+    }
+
+    void processStream(int streamId)
+    {
+        IngestStream *stream = acquireStream(streamId);
+        if (!stream) {
+            return;
+        }
+        // no lock held: a sink that is slow to take a packet must not
+        // block addStream()/removeStream() of the other streams
+        if (!readStream(stream)) {
+            stopStream(stream);
+        }
+        releaseStream(stream);
+    }
+
+    void feedPendingStreams()
+    {
+        QVector<int> streamIds;
+        {
+            QMutexLocker locker(&m_mutex);
+            streamIds.swap(m_pendingStreams);
+        }
+        for (int streamId : streamIds) {
+            processStream(streamId);
+        }
+    }
+
+    bool isQuit()
+    {
+        QMutexLocker locker(&m_mutex);
+        return m_quit;
+    }
+
+    IngestStream *acquireStream(int streamId)
+    {
+        QMutexLocker locker(&m_mutex);
+        // the stream may have been removed after the event was fetched
+        IngestStream *stream = m_streams.value(streamId, Q_NULLPTR);
+        if (!stream || stream->stopped) {
+            return Q_NULLPTR;
+        }
+        stream->busy = true;
+        return stream;
+    }
+
+    void releaseStream(IngestStream *stream)
+    {
+        QMutexLocker locker(&m_mutex);
+        stream->busy = false;
+        m_idleCond.wakeAll();
+    }
+
+    bool readStream(IngestStream *stream)
+    {
+        if (!stream->pending.isEmpty()) {
+            QByteArray pending;
+            pending.swap(stream->pending);
+            if (!streamFeed(stream, pending)) {
+                return false;
+            }
+        }
+        int budget = INGEST_READ_BUDGET;
+        while (budget > 0) {
+            int wanted = 0;
+            quint8 *buf = streamNextBuffer(stream, wanted);
+            ssize_t len = ::recv(stream->fd, buf, static_cast<size_t>(wanted), 0);
+            if (0 == len) {
+                // end of stream
+                return false;
+            }
+            if (len < 0) {
+                if (EINTR == errno) {
+                    continue;
+                }
+                // level triggered: we will be called again once more data arrived
+                return EAGAIN == errno || EWOULDBLOCK == errno;
+            }
+            budget -= static_cast<int>(len);
+            if (!streamCommit(stream, static_cast<int>(len))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void stopStream(IngestStream *stream)
+    {
+        epoll_ctl(m_epollFd, EPOLL_CTL_DEL, stream->fd, Q_NULLPTR);
+        stream->stopped = true;
+        av_packet_unref(stream->packet);
+        stream->inPayload = false;
+        stream->sink->onIngestStop();
+    }
+
+private:
+    int m_epollFd = -1;
+    int m_wakeFd = -1;
+    QMutex m_mutex;
+    QWaitCondition m_idleCond;
+    QHash<int, IngestStream *> m_streams;
+    // added with bytes to parse, see IngestStream::pending
+    QVector<int> m_pendingStreams;
+    bool m_quit = false;
+};
+
+#else
+
+// never instantiated, see IngestEngine::isSupported()
+class IngestWorker
+{
+public:
+    bool addStream(IngestStream *) { return false; }
+    IngestStream *takeStream(int) { return Q_NULLPTR; }
+    int streamCount() { return 0; }
+};
+
+#endif
+
+static void streamFree(IngestStream *stream)
+{
+    if (!stream) {
+        return;
+    }
+#ifdef Q_OS_LINUX
+    if (-1 != stream->fd) {
+        ::close(stream->fd);
+    }
+#endif
+    av_packet_free(&stream->packet);
+    delete stream;
+}
+
+IngestEngine::IngestEngine() {}
+
+IngestEngine::~IngestEngine()
+{
+    stop();
+}
+
+IngestEngine &IngestEngine::instance()
+{
+    static IngestEngine engine;
+    return engine;
+}
+
+bool IngestEngine::isSupported()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+int IngestEngine::addStream(qintptr socketDescriptor, const QByteArray &initialData, Sink *sink)
+{
+    if (!isSupported() || !sink || socketDescriptor < 0) {
+        return -1;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (m_workers.isEmpty() && !start()) {
+        return -1;
+    }
+
+    IngestStream *stream = new IngestStream;
+    stream->id = m_nextStreamId++;
+    stream->sink = sink;
+    stream->packet = av_packet_alloc();
+    if (!stream->packet) {
+        qCritical("OOM");
+        delete stream;
+        return -1;
+    }
+
+    // parsed on the io thread, the sink must not run under m_mutex
+    stream->pending = initialData;
+
+#ifdef Q_OS_LINUX
+    int flags = fcntl(static_cast<int>(socketDescriptor), F_GETFL, 0);
+    fcntl(static_cast<int>(socketDescriptor), F_SETFL, flags | O_NONBLOCK);
+#endif
+    stream->fd = static_cast<int>(socketDescriptor);
+
+    // the least loaded io thread
+    IngestWorker *worker = m_workers[m_nextWorker];
+    for (int i = 0; i < m_workers.size(); i++) {
+        if (m_workers[i]->streamCount() < worker->streamCount()) {
+            worker = m_workers[i];
+        }
+    }
+    m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+
+    if (!worker->addStream(stream)) {
+        // the caller keeps the ownership of the descriptor on failure
+        stream->fd = -1;
+        streamFree(stream);
+        return -1;
+    }
+    m_streamWorkers.insert(stream->id, worker);
+    return stream->id;
+}
+
+void IngestEngine::removeStream(int streamId)
+{
+    IngestWorker *worker = Q_NULLPTR;
+    {
+        QMutexLocker locker(&m_mutex);
+        worker = m_streamWorkers.take(streamId);
+    }
+    if (!worker) {
+        return;
+    }
+    streamFree(worker->takeStream(streamId));
+}
+
+bool IngestEngine::start()
+{
+#ifdef Q_OS_LINUX
+    int count = qBound(1, QThread::idealThreadCount() / 2, INGEST_MAX_WORKERS);
+    for (int i = 0; i < count; i++) {
+        IngestWorker *worker = new IngestWorker();
+        if (!worker->init()) {
+            delete worker;
+            stop();
+            return false;
+        }
+        worker->start();
+        m_workers.append(worker);
+    }
+    qInfo("native ingest started with %d io threads", count);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IngestEngine::stop()
+{
+#ifdef Q_OS_LINUX
+    for (IngestWorker *worker : m_workers) {
+        delete worker;
+    }
+#endif
+    m_workers.clear();
+    m_streamWorkers.clear();
+}
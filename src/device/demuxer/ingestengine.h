@@ -0,0 +1,59 @@
+#ifndef INGESTENGINE_H
+#define INGESTENGINE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QVector>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+}
+
+// Native video socket ingest: a fixed number of io threads, each one waiting
+// with epoll on many video sockets and parsing the scrcpy packet framing
+// incrementally, instead of one blocking Demuxer thread per device.
+// Only available on Linux, see isSupported().
+class IngestWorker;
+class IngestEngine
+{
+public:
+    class Sink
+    {
+    public:
+        virtual ~Sink() {}
+        // called on an io thread for every complete packet (or from addStream() for
+        // packets completed by its initialData), the packet is unreferenced after
+        // the call, return false to stop the stream
+        virtual bool onIngestPacket(AVPacket *packet) = 0;
+        // called on an io thread once, when the stream ends (eof, error or rejected packet)
+        virtual void onIngestStop() = 0;
+    };
+
+    static IngestEngine &instance();
+    static bool isSupported();
+
+    // takes ownership of socketDescriptor, initialData are bytes already read from it
+    // returns the stream id, or -1 on failure
+    int addStream(qintptr socketDescriptor, const QByteArray &initialData, Sink *sink);
+    // closes the stream, once returned the sink is never called anymore
+    // must not be called from a sink callback
+    void removeStream(int streamId);
+
+private:
+    IngestEngine();
+    ~IngestEngine();
+    bool start();
+    void stop();
+
+private:
+    QMutex m_mutex;
+    QVector<IngestWorker *> m_workers;
+    QHash<int, IngestWorker *> m_streamWorkers;
+    int m_nextStreamId = 0;
+    int m_nextWorker = 0;
+};
+
+#endif // INGESTENGINE_H
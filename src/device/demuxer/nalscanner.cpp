@@ -0,0 +1,130 @@
+#include <QtAlgorithms>
+
+#include "nalscanner.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NAL_SCANNER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#define NAL_SCANNER_NEON
+#include <arm_neon.h>
+#endif
+
+int NalScanner::findStartCode(const quint8 *data, int size)
+{
+    int i = 0;
+#if defined(NAL_SCANNER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    // 16 candidate positions per step: data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1
+    for (; i + 18 <= size; i += 16) {
+        __m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 1));
+        __m128i b2 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i + 2));
+        __m128i match = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b1, zero)), _mm_cmpeq_epi8(b2, one));
+        int bits = _mm_movemask_epi8(match);
+        if (bits) {
+            return i + static_cast<int>(qCountTrailingZeroBits(static_cast<quint32>(bits)));
+        }
+    }
+#elif defined(NAL_SCANNER_NEON)
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t one = vdupq_n_u8(1);
+    for (; i + 18 <= size; i += 16) {
+        uint8x16_t b0 = vld1q_u8(data + i);
+        uint8x16_t b1 = vld1q_u8(data + i + 1);
+        uint8x16_t b2 = vld1q_u8(data + i + 2);
+        uint8x16_t match = vandq_u8(vandq_u8(vceqq_u8(b0, zero), vceqq_u8(b1, zero)), vceqq_u8(b2, one));
+        uint64x2_t match64 = vreinterpretq_u64_u8(match);
+        if (vgetq_lane_u64(match64, 0) | vgetq_lane_u64(match64, 1)) {
+            // rare, locate it in the 16 candidates
+            break;
+        }
+    }
+#endif
+    int r = findStartCodeC(data + i, size - i);
+    return r < 0 ? -1 : i + r;
+}
+
+int NalScanner::findStartCodeC(const quint8 *data, int size)
+{
+    int i = 0;
+    while (i + 3 <= size) {
+        if (data[i + 2] > 1) {
+            // no start code can begin at i, i + 1 or i + 2
+            i += 3;
+        } else if (data[i + 2] == 1) {
+            if (data[i] == 0 && data[i + 1] == 0) {
+                return i;
+            }
+            i += 3;
+        } else {
+            i++;
+        }
+    }
+    return -1;
+}
+
+NalInfo NalScanner::scanH264(const quint8 *data, int size, bool full)
+{
+    NalInfo info;
+    if (!data) {
+        return info;
+    }
+
+    int pos = 0;
+    for (;;) {
+        int startCode = findStartCode(data + pos, size - pos);
+        if (startCode < 0) {
+            break;
+        }
+        int header = pos + startCode + 3;
+        if (header >= size) {
+            break;
+        }
+
+        int type = data[header] & 0x1f;
+        info.typeMask |= Q_UINT64_C(1) << type;
+        info.count++;
+        if (H264_NAL_IDR == type) {
+            info.keyFrame = true;
+        }
+        if (!full && type >= H264_NAL_SLICE && type <= H264_NAL_IDR) {
+            break;
+        }
+        pos = header + 1;
+    }
+    return info;
+}
+
+NalInfo NalScanner::scanH265(const quint8 *data, int size, bool full)
+{
+    NalInfo info;
+    if (!data) {
+        return info;
+    }
+
+    int pos = 0;
+    for (;;) {
+        int startCode = findStartCode(data + pos, size - pos);
+        if (startCode < 0) {
+            break;
+        }
+        int header = pos + startCode + 3;
+        if (header >= size) {
+            break;
+        }
+
+        int type = (data[header] >> 1) & 0x3f;
+        info.typeMask |= Q_UINT64_C(1) << type;
+        info.count++;
+        if (type >= H265_NAL_IRAP_FIRST && type <= H265_NAL_IRAP_LAST) {
+            info.keyFrame = true;
+        }
+        if (!full && type <= H265_NAL_VCL_LAST) {
+            break;
+        }
+        pos = header + 1;
+    }
+    return info;
+}
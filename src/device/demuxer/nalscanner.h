@@ -0,0 +1,54 @@
+#ifndef NALSCANNER_H
+#define NALSCANNER_H
+
+#include <QtGlobal>
+
+// summary of the annex-b nal units of one packet
+struct NalInfo
+{
+    quint64 typeMask = 0; // bit n is set if a nal unit of type n is present
+    int count = 0;        // nal units found
+    bool keyFrame = false;
+
+    bool has(int type) const { return typeMask & (Q_UINT64_C(1) << type); }
+};
+
+// Lightweight annex-b scanner: finds start codes (SSE2/NEON when available)
+// and reads the nal unit types, without any parser/codec context.
+class NalScanner
+{
+public:
+    enum H264NalType
+    {
+        H264_NAL_SLICE = 1,
+        H264_NAL_IDR = 5,
+        H264_NAL_SEI = 6,
+        H264_NAL_SPS = 7,
+        H264_NAL_PPS = 8,
+    };
+
+    enum H265NalType
+    {
+        H265_NAL_IRAP_FIRST = 16, // BLA/IDR/CRA
+        H265_NAL_IRAP_LAST = 23,
+        H265_NAL_VCL_LAST = 31,
+        H265_NAL_VPS = 32,
+        H265_NAL_SPS = 33,
+        H265_NAL_PPS = 34,
+        H265_NAL_PREFIX_SEI = 39,
+    };
+
+    // offset of the next 00 00 01 start code in data, or -1
+    static int findStartCode(const quint8 *data, int size);
+
+    // by default the scan stops at the first slice: every slice of a picture
+    // has the same type, so the (big) remaining slice data can be skipped
+    static NalInfo scanH264(const quint8 *data, int size, bool full = false);
+    // same for hevc, the nal unit type is 6 bits (2 bytes nal header)
+    static NalInfo scanH265(const quint8 *data, int size, bool full = false);
+
+private:
+    static int findStartCodeC(const quint8 *data, int size);
+};
+
+#endif // NALSCANNER_H
@@ -0,0 +1,93 @@
+#include <climits>
+#include <cstring>
+#include <QDebug>
+
+#include "packetpool.h"
+
+// packets seen before the pool size is reconsidered
+#define POOL_WINDOW_PACKETS 240
+#define POOL_MIN_BUFFER_SIZE (64 * 1024)
+#define POOL_BUFFER_ALIGN 4096
+
+static int alignBufferSize(int size)
+{
+    // keep some headroom so that slightly bigger frames still fit
+    qint64 wanted = static_cast<qint64>(size) + size / 2;
+    wanted = qMax<qint64>(wanted, POOL_MIN_BUFFER_SIZE);
+    wanted = (wanted + POOL_BUFFER_ALIGN - 1) / POOL_BUFFER_ALIGN * POOL_BUFFER_ALIGN;
+    return static_cast<int>(qMin<qint64>(wanted, INT_MAX - AV_INPUT_BUFFER_PADDING_SIZE));
+}
+
+PacketPool::PacketPool() {}
+
+PacketPool::~PacketPool()
+{
+    deInit();
+}
+
+bool PacketPool::allocPacket(AVPacket *packet, int size)
+{
+    if (!packet || size < 0) {
+        return false;
+    }
+
+    if (size > m_bufferSize) {
+        // an exceptionally big frame (usually a key frame), grow the pool
+        if (!resize(alignBufferSize(size))) {
+            return false;
+        }
+    }
+
+    m_windowMax = qMax(m_windowMax, size);
+    if (++m_windowCount >= POOL_WINDOW_PACKETS) {
+        // the stream got lighter (lower resolution, static content...),
+        // give back the memory
+        int fit = alignBufferSize(m_windowMax);
+        if (fit * 2 < m_bufferSize) {
+            resize(fit);
+        }
+        m_windowMax = 0;
+        m_windowCount = 0;
+    }
+
+    AVBufferRef *buf = av_buffer_pool_get(m_pool);
+    if (!buf) {
+        return false;
+    }
+
+    packet->buf = buf;
+    packet->data = buf->data;
+    packet->size = size;
+    // recycled buffers are dirty, but the padding must be zeroed
+    memset(packet->data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+    return true;
+}
+
+void PacketPool::deInit()
+{
+    if (m_pool) {
+        // the pool is really freed once the last packet referencing it is released
+        av_buffer_pool_uninit(&m_pool);
+    }
+    m_bufferSize = 0;
+    m_windowMax = 0;
+    m_windowCount = 0;
+}
+
+bool PacketPool::resize(int bufferSize)
+{
+    AVBufferPool *pool = av_buffer_pool_init(bufferSize + AV_INPUT_BUFFER_PADDING_SIZE, Q_NULLPTR);
+    if (!pool) {
+        qCritical("Could not allocate packet pool");
+        return false;
+    }
+
+    if (m_pool) {
+        // buffers still in flight keep the old pool alive
+        av_buffer_pool_uninit(&m_pool);
+    }
+    m_pool = pool;
+    m_bufferSize = bufferSize;
+    qDebug() << "packet pool buffer size:" << bufferSize;
+    return true;
+}
@@ -0,0 +1,38 @@
+#ifndef PACKETPOOL_H
+#define PACKETPOOL_H
+
+#include <QtGlobal>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+}
+
+// Recycled, ref-counted payload buffers for incoming video packets.
+// The pool buffer size follows the recent packet sizes, so in steady state
+// every packet is served from the pool without touching the allocator.
+// Not thread safe: one pool per producer thread.
+class PacketPool
+{
+public:
+    PacketPool();
+    virtual ~PacketPool();
+
+    // make an empty packet reference a pooled buffer of size bytes
+    // (plus zeroed AV_INPUT_BUFFER_PADDING_SIZE)
+    bool allocPacket(AVPacket *packet, int size);
+    void deInit();
+
+private:
+    bool resize(int bufferSize);
+
+private:
+    AVBufferPool *m_pool = Q_NULLPTR;
+    int m_bufferSize = 0;
+
+    // largest packet seen in the current window
+    int m_windowMax = 0;
+    int m_windowCount = 0;
+};
+
+#endif // PACKETPOOL_H
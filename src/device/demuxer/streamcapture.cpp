@@ -0,0 +1,76 @@
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "latencytracker.h"
+#include "streamcapture.h"
+
+static void bufferWrite32be(quint8 *buf, quint32 value)
+{
+    buf[0] = value >> 24;
+    buf[1] = (value >> 16) & 0xff;
+    buf[2] = (value >> 8) & 0xff;
+    buf[3] = value & 0xff;
+}
+
+static void bufferWrite64be(quint8 *buf, quint64 value)
+{
+    bufferWrite32be(buf, value >> 32);
+    bufferWrite32be(&buf[4], static_cast<quint32>(value));
+}
+
+StreamCapture::StreamCapture(const QString &fileName) : m_fileName(fileName), m_file(fileName) {}
+
+StreamCapture::~StreamCapture()
+{
+    close();
+}
+
+bool StreamCapture::open()
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qCritical() << QString("Failed to open capture file: %1").arg(m_fileName).toUtf8().toStdString().c_str();
+        return false;
+    }
+    if (STREAM_CAPTURE_MAGIC_SIZE != m_file.write(STREAM_CAPTURE_MAGIC, STREAM_CAPTURE_MAGIC_SIZE)) {
+        m_file.close();
+        return false;
+    }
+    m_startTime = LatencyTracker::now();
+    m_failed = false;
+    qInfo() << QString("capture video stream to %1").arg(m_fileName).toStdString().c_str();
+    return true;
+}
+
+void StreamCapture::close()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool StreamCapture::writeRecord(const quint8 *header, qint32 headerLen, const quint8 *data, qint32 dataLen)
+{
+    qint64 time = LatencyTracker::now() - m_startTime;
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen() || m_failed) {
+        return false;
+    }
+
+    quint8 recordHeader[STREAM_CAPTURE_RECORD_HEADER_SIZE];
+    bufferWrite64be(recordHeader, static_cast<quint64>(time));
+    bufferWrite32be(&recordHeader[8], static_cast<quint32>(headerLen + dataLen));
+
+    bool ok = STREAM_CAPTURE_RECORD_HEADER_SIZE == m_file.write((const char *)recordHeader, STREAM_CAPTURE_RECORD_HEADER_SIZE);
+    ok = ok && headerLen == m_file.write((const char *)header, headerLen);
+    if (ok && data && dataLen > 0) {
+        ok = dataLen == m_file.write((const char *)data, dataLen);
+    }
+    if (!ok) {
+        // keep streaming, stop capturing
+        qCritical() << QString("Failed to write capture file: %1").arg(m_fileName).toUtf8().toStdString().c_str();
+        m_failed = true;
+    }
+    return ok;
+}
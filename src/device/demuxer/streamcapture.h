@@ -0,0 +1,38 @@
+#ifndef STREAMCAPTURE_H
+#define STREAMCAPTURE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+
+// capture file layout:
+// "QSCCAP01", then records of
+// [8 bytes arrival time in us since the capture start][4 bytes length][raw bytes]
+// the first record is the device info header (see Server::readInfo), every
+// following record is one 12 bytes meta header plus its packet, as sent by the server
+#define STREAM_CAPTURE_MAGIC "QSCCAP01"
+#define STREAM_CAPTURE_MAGIC_SIZE 8
+#define STREAM_CAPTURE_RECORD_HEADER_SIZE 12
+
+// Tees the raw video socket bytes to a file, with their arrival time.
+class StreamCapture
+{
+public:
+    StreamCapture(const QString &fileName);
+    virtual ~StreamCapture();
+
+    bool open();
+    void close();
+    // the record is header followed by data
+    bool writeRecord(const quint8 *header, qint32 headerLen, const quint8 *data = Q_NULLPTR, qint32 dataLen = 0);
+
+private:
+    QString m_fileName;
+    QFile m_file;
+    QMutex m_mutex;
+    qint64 m_startTime = 0;
+    bool m_failed = false;
+};
+
+#endif // STREAMCAPTURE_H
@@ -0,0 +1,130 @@
+#include <QDebug>
+#include <QMutexLocker>
+
+#include "latencytracker.h"
+#include "streamcapture.h"
+#include "streamreplay.h"
+
+static quint32 bufferRead32be(const quint8 *buf)
+{
+    return static_cast<quint32>((buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3]);
+}
+
+static quint64 bufferRead64be(const quint8 *buf)
+{
+    quint32 msb = bufferRead32be(buf);
+    quint32 lsb = bufferRead32be(&buf[4]);
+    return (static_cast<quint64>(msb) << 32) | lsb;
+}
+
+StreamReplay::StreamReplay(const QString &fileName, bool realtime) : m_fileName(fileName), m_file(fileName), m_realtime(realtime) {}
+
+StreamReplay::~StreamReplay()
+{
+    close();
+}
+
+bool StreamReplay::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qCritical() << QString("Failed to open replay file: %1").arg(m_fileName).toUtf8().toStdString().c_str();
+        return false;
+    }
+    QByteArray magic = m_file.read(STREAM_CAPTURE_MAGIC_SIZE);
+    if (magic != QByteArray(STREAM_CAPTURE_MAGIC, STREAM_CAPTURE_MAGIC_SIZE)) {
+        qCritical() << QString("Not a capture file: %1").arg(m_fileName).toUtf8().toStdString().c_str();
+        m_file.close();
+        return false;
+    }
+    m_recordRemain = 0;
+    m_startTime = -1;
+    return true;
+}
+
+void StreamReplay::close()
+{
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+bool StreamReplay::readDeviceInfo(QByteArray &deviceInfo)
+{
+    if (!nextRecord()) {
+        return false;
+    }
+    deviceInfo = m_file.read(m_recordRemain);
+    if (deviceInfo.size() != m_recordRemain) {
+        return false;
+    }
+    m_recordRemain = 0;
+    return true;
+}
+
+qint32 StreamReplay::recvData(quint8 *buf, qint32 bufSize)
+{
+    if (!buf) {
+        return 0;
+    }
+
+    qint32 recvLen = 0;
+    while (recvLen < bufSize) {
+        if (!m_recordRemain) {
+            if (!nextRecord() || !waitRecordTime()) {
+                // end of stream or interrupted
+                return recvLen;
+            }
+        }
+        qint64 len = m_file.read((char *)buf + recvLen, qMin<qint64>(bufSize - recvLen, m_recordRemain));
+        if (len <= 0) {
+            return recvLen;
+        }
+        m_recordRemain -= len;
+        recvLen += static_cast<qint32>(len);
+    }
+    return recvLen;
+}
+
+void StreamReplay::interrupt()
+{
+    QMutexLocker locker(&m_mutex);
+    m_interrupted = true;
+    m_interruptCond.wakeOne();
+}
+
+bool StreamReplay::nextRecord()
+{
+    quint8 header[STREAM_CAPTURE_RECORD_HEADER_SIZE];
+    if (STREAM_CAPTURE_RECORD_HEADER_SIZE != m_file.read((char *)header, STREAM_CAPTURE_RECORD_HEADER_SIZE)) {
+        return false;
+    }
+    m_recordTime = static_cast<qint64>(bufferRead64be(header));
+    m_recordRemain = bufferRead32be(&header[8]);
+    return true;
+}
+
+bool StreamReplay::waitRecordTime()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_interrupted) {
+        return false;
+    }
+    if (!m_realtime) {
+        return true;
+    }
+
+    if (-1 == m_startTime) {
+        // the first packet is replayed right away
+        m_startTime = LatencyTracker::now() - m_recordTime;
+    }
+    for (;;) {
+        qint64 delay = m_startTime + m_recordTime - LatencyTracker::now();
+        if (delay <= 0) {
+            return true;
+        }
+        m_interruptCond.wait(&m_mutex, static_cast<unsigned long>((delay + 999) / 1000));
+        if (m_interrupted) {
+            return false;
+        }
+    }
+}
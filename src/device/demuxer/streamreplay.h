@@ -0,0 +1,45 @@
+#ifndef STREAMREPLAY_H
+#define STREAMREPLAY_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QWaitCondition>
+
+// Replays a StreamCapture file in place of the video socket,
+// either at the recorded pace or as fast as possible.
+class StreamReplay
+{
+public:
+    StreamReplay(const QString &fileName, bool realtime = true);
+    virtual ~StreamReplay();
+
+    bool open();
+    void close();
+    // the device info header, must be read first
+    bool readDeviceInfo(QByteArray &deviceInfo);
+    // blocking, same contract as VideoSocket::subThreadRecvData()
+    qint32 recvData(quint8 *buf, qint32 bufSize);
+    // wake up and avoid any blocking call
+    void interrupt();
+
+private:
+    bool nextRecord();
+    bool waitRecordTime();
+
+private:
+    QString m_fileName;
+    QFile m_file;
+    bool m_realtime = true;
+
+    qint64 m_recordTime = 0;
+    qint64 m_recordRemain = 0;
+    qint64 m_startTime = -1;
+
+    QMutex m_mutex;
+    QWaitCondition m_interruptCond;
+    bool m_interrupted = false;
+};
+
+#endif // STREAMREPLAY_H
@@ -1,5 +1,7 @@
 #include <QDir>
+#include <QFileInfo>
 #include <QMessageBox>
+#include <QThread>
 #include <QTimer>
 
 #include "controller.h"
@@ -7,25 +9,98 @@
 #include "decoder.h"
 #include "device.h"
 #include "filehandler.h"
+#include "framedispatcher.h"
+#include "latencytracker.h"
 #include "recorder.h"
+#include "replaybuffer.h"
+#include "screenshotencoder.h"
 #include "server.h"
 #include "demuxer.h"
+#include "streamcapture.h"
+#include "streamreplay.h"
 
 namespace qsc {
 
+static AVCodecID videoCodecId(const QString &videoCodec)
+{
+    if ("h265" == videoCodec) {
+        return AV_CODEC_ID_HEVC;
+    }
+    if ("av1" == videoCodec) {
+        return AV_CODEC_ID_AV1;
+    }
+    return AV_CODEC_ID_H264;
+}
+
+// the last reference to a recorder may be dropped by the stream thread
+static void releaseRecorder(Recorder *recorder)
+{
+    if (QThread::currentThread() == recorder->thread()) {
+        // waits for the file to be closed if still recording
+        delete recorder;
+    } else {
+        recorder->deleteLater();
+    }
+}
+
 Device::Device(DeviceParams params, QObject *parent) : IDevice(parent), m_params(params)
 {
+    m_latencyTracker = new LatencyTracker();
+    m_frameDispatcher = new FrameDispatcher();
+
     if (!params.display && !m_params.recordFile) {
         qCritical("not display must be recorded");
         return;
     }
 
     if (params.display) {
-        m_decoder = new Decoder([this](int width, int height, uint8_t* dataY, uint8_t* dataU, uint8_t* dataV, int linesizeY, int linesizeU, int linesizeV) {
-            for (const auto& item : m_deviceObservers) {
-                item->onFrame(width, height, dataY, dataU, dataV, linesizeY, linesizeU, linesizeV);
-            }
+        m_decoder = new Decoder([this](const AVFrame *frame) {
+            m_frameDispatcher->dispatchGui(frame);
         }, this);
+        m_decoder->setFrameTap([this](const AVFrame *frame) {
+            m_frameDispatcher->dispatchAsync(frame);
+        });
+        if (params.thumbnailWidth > 0) {
+            m_decoder->setThumbnail(params.thumbnailWidth, TF_NV12 == params.thumbnailFormat ? AV_PIX_FMT_NV12 : AV_PIX_FMT_RGB32, params.thumbnailImageFps);
+            if (params.thumbnailOnly) {
+                m_decoder->setThumbnailProfile(params.thumbnailKeyFramesOnly);
+            }
+            connect(m_decoder, &Decoder::newThumbnail, this, [this](const FrameRef &thumbnail) {
+                for (const auto& item : m_deviceObservers) {
+                    item->onThumbnail(thumbnail);
+                }
+            });
+        }
+        if (params.dirtyTileSize > 0) {
+            m_decoder->setDirtyDetection(params.dirtyTileSize, params.dirtyThreshold);
+            m_stableTimer = new QTimer(this);
+            m_stableTimer->setSingleShot(true);
+            m_stableTimer->setInterval(params.screenStableMs);
+            connect(m_stableTimer, &QTimer::timeout, this, [this]() {
+                setScreenStable(true);
+            });
+            connect(m_decoder, &Decoder::newDirtyRegion, this, &Device::onDirtyRegion);
+            connect(m_decoder, &Decoder::dirtyDetectionSkipping, this, &Device::onDirtyDetectionSkipping);
+        }
+        if (params.exportMotion) {
+            m_decoder->setMotionExport(params.motionCellSize);
+            connect(m_decoder, &Decoder::newMotion, this, [this](const MotionInfo &motion) {
+                for (const auto& item : m_deviceObservers) {
+                    item->onMotion(motion);
+                }
+            });
+        }
+        m_decoder->setLatencyTracker(m_latencyTracker);
+        m_decoder->setThreading(params.decodeThreads, DTT_FRAME == params.decodeThreadType);
+        if (params.nativeIngest && IngestEngine::isSupported()) {
+            // the io threads serve many devices, a slow decoder must not block them
+            m_decoder->setPacketQueue(qMax(params.decodeQueueSize, 16), true);
+        } else {
+            m_decoder->setPacketQueue(params.decodeQueueSize, params.decodeQueueDropUntilKeyFrame);
+        }
+        FrameBufferPolicy frameBufferPolicy = params.renderExpiredFrames ? FBP_BLOCK : params.frameBufferPolicy;
+        m_decoder->setFrameBuffer(frameBufferPolicy, params.frameBufferDepth);
+        m_frameDispatcher->setGuiDepth(FBP_LATEST == frameBufferPolicy ? 1 : params.frameBufferDepth);
         m_fileHandler = new FileHandler(this);
         m_controller = new Controller([this](const QByteArray& buffer) -> qint64 {
             if (!m_server || !m_server->getControlSocket()) {
@@ -37,27 +112,13 @@ Device::Device(DeviceParams params, QObject *parent) : IDevice(parent), m_params
     }
 
     m_stream = new Demuxer(this);
+    m_stream->setLatencyTracker(m_latencyTracker);
 
     m_server = new Server(this);
-    if (m_params.recordFile && !m_params.recordPath.trimmed().isEmpty()) {
-        QString absFilePath;
-        QString fileDir(m_params.recordPath);
-        if (!fileDir.isEmpty()) {
-            QDateTime dateTime = QDateTime::currentDateTime();
-            QString fileName = dateTime.toString("_yyyyMMdd_hhmmss_zzz");
-            fileName = m_params.serial + fileName;
-            fileName.replace(":", "_");
-            fileName.replace(".", "_");
-            fileName += ("." + m_params.recordFileFormat);
-            QDir dir(fileDir);
-            if (!dir.exists()) {
-                if (!dir.mkpath(fileDir)) {
-                    qCritical() << QString("Failed to create the save folder: %1").arg(fileDir);
-                }
-            }
-            absFilePath = dir.absoluteFilePath(fileName);
-        }
-        m_recorder = new Recorder(absFilePath, this);
+    m_recordConfig = av_packet_alloc();
+    if (m_params.replayBufferSeconds > 0) {
+        m_replayBuffer = new ReplayBuffer();
+        m_replayBuffer->setup(m_params.replayBufferSeconds, m_params.replayBufferMB);
     }
     initSignals();
 }
@@ -65,6 +126,14 @@ Device::Device(DeviceParams params, QObject *parent) : IDevice(parent), m_params
 Device::~Device()
 {
     Device::disconnectDevice();
+    // the demuxer/decoder threads are stopped now
+    delete m_frameDispatcher;
+    m_frameDispatcher = Q_NULLPTR;
+    delete m_latencyTracker;
+    m_latencyTracker = Q_NULLPTR;
+    delete m_replayBuffer;
+    m_replayBuffer = Q_NULLPTR;
+    av_packet_free(&m_recordConfig);
 }
 
 void Device::setUserData(void *data)
@@ -78,12 +147,19 @@ void *Device::getUserData()
 }
 
 void Device::registerDeviceObserver(DeviceObserver *observer)
+{
+    registerDeviceObserver(observer, ObserverOptions());
+}
+
+void Device::registerDeviceObserver(DeviceObserver *observer, const ObserverOptions &options)
 {
     m_deviceObservers.insert(observer);
+    m_frameDispatcher->addObserver(observer, options);
 }
 
 void Device::deRegisterDeviceObserver(DeviceObserver *observer)
 {
+    m_frameDispatcher->removeObserver(observer);
     m_deviceObservers.erase(observer);
 }
 
@@ -101,14 +177,199 @@ void Device::updateScript(QString script)
 
 void Device::screenshot()
 {
-    if (!m_decoder) {
+    ScreenshotOptions options;
+    options.format = SF_PNG;
+    options.quality = 100;
+    options.saveToFile = true;
+    screenshot(options, Q_NULLPTR);
+}
+
+void Device::screenshot(const ScreenshotOptions &options, std::function<void(const ScreenshotResult &)> callback)
+{
+    FrameRef frame;
+    if (m_decoder) {
+        frame = m_decoder->lastFrame();
+    }
+    if (!frame.isValid()) {
+        if (callback) {
+            ScreenshotResult result;
+            result.format = options.format;
+            callback(result);
+        }
         return;
     }
 
-    // screenshot
-    m_decoder->peekFrame([this](int width, int height, uint8_t* dataRGB32) {
-       saveFrame(width, height, dataRGB32);
-    });
+    QString filePath;
+    if (options.saveToFile) {
+        filePath = saveFilePath("", ScreenshotEncoder::fileSuffix(options.format));
+    }
+    if (!callback && filePath.isEmpty()) {
+        return;
+    }
+    // the frame is only referenced, converting and encoding run on a worker
+    ScreenshotEncoder::encodeAsync(frame, options, filePath, this, callback);
+}
+
+void Device::saveReplayBuffer(const QString &filePath, std::function<void(bool, const QString &)> callback)
+{
+    ReplayBuffer::Clip clip;
+    QString fileName = filePath;
+    if (fileName.isEmpty()) {
+        fileName = saveFilePath("_replay", m_params.recordFileFormat);
+    }
+    // copied under the ring lock, muxed on a worker
+    if (!m_replayBuffer || fileName.isEmpty() || !m_replayBuffer->snapshot(clip)) {
+        if (callback) {
+            callback(false, "");
+        }
+        return;
+    }
+    ReplayBuffer::saveAsync(clip, fileName, this, callback);
+}
+
+bool Device::startRecording(const QString &filePath, const QString &format)
+{
+    if (!m_serverStartSuccess || AV_CODEC_ID_NONE == m_codecId) {
+        qWarning("start recording: the device is not connected");
+        return false;
+    }
+    if (isRecording()) {
+        qWarning("start recording: already recording");
+        return false;
+    }
+
+    QString formatName = format;
+    if (formatName.isEmpty()) {
+        formatName = filePath.isEmpty() ? m_params.recordFileFormat : QFileInfo(filePath).suffix();
+    }
+    Recorder::RecorderFormat recordFormat = Recorder::formatFromName(formatName);
+    if (Recorder::RECORDER_FORMAT_NULL == recordFormat) {
+        qWarning() << "start recording: unsupported format" << formatName;
+        return false;
+    }
+    QString fileName = filePath.isEmpty() ? saveFilePath("", formatName) : filePath;
+    if (fileName.isEmpty()) {
+        return false;
+    }
+
+    QSharedPointer<Recorder> recorder(new Recorder(fileName), releaseRecorder);
+    recorder->setFormat(recordFormat);
+    recorder->setQueue(m_params.recordQueueSize, m_params.recordQueueDropUntilKeyFrame);
+    recorder->setSegment(m_params.recordSegmentSeconds, m_params.recordSegmentMB);
+    recorder->setFragmented(m_params.recordFragmented);
+    recorder->setOutput(static_cast<int>(qMin(m_params.recordWriteBufferKB, 65536u)) * 1024, m_params.recordSyncPolicy, m_params.recordSyncSeconds);
+    recorder->setFrameSize(m_frameSize);
+    recorder->setCodecId(m_codecId);
+    if (!recorder->open() || !recorder->startRecorder()) {
+        qCritical("Could not start recorder");
+        return false;
+    }
+    // the file is closed on the writer thread, the recorder is released here
+    Recorder *stopped = recorder.data();
+    connect(stopped, &Recorder::recordStopped, this, [this, stopped](bool success) {
+        if (!success) {
+            qWarning("recording failed");
+        }
+        QSharedPointer<Recorder> current;
+        {
+            QMutexLocker locker(&m_recorderMutex);
+            if (m_recorder.data() == stopped) {
+                // failed while recording
+                current = m_recorder;
+                m_recorder.clear();
+            }
+        }
+        for (int i = 0; i < m_recordings.size(); i++) {
+            if (m_recordings.at(i).data() == stopped) {
+                m_recordings.removeAt(i);
+                break;
+            }
+        }
+    }, Qt::QueuedConnection);
+    m_recordings.append(recorder);
+
+    bool midStream = false;
+    {
+        QMutexLocker locker(&m_recorderMutex);
+        if (m_recordConfig->size > 0) {
+            // mid stream: no config packet is coming, the data packets are
+            // skipped until the next key frame
+            recorder->push(m_recordConfig);
+            midStream = true;
+        }
+        m_recorder = recorder;
+    }
+    if (midStream && m_controller) {
+        // do not wait for the periodic key frame
+        m_controller->resetVideo();
+    }
+    return true;
+}
+
+void Device::stopRecording()
+{
+    QSharedPointer<Recorder> recorder;
+    {
+        QMutexLocker locker(&m_recorderMutex);
+        recorder = m_recorder;
+        m_recorder.clear();
+    }
+    if (recorder) {
+        // a packet the stream thread is pushing meanwhile is not recorded
+        recorder->stopRecorder();
+    }
+}
+
+bool Device::isRecording()
+{
+    QMutexLocker locker(&m_recorderMutex);
+    return !m_recorder.isNull();
+}
+
+void Device::setDecodeScheduler(DecodeScheduler *scheduler)
+{
+    if (m_decoder && scheduler) {
+        m_decoder->setScheduler(scheduler, m_params.decodePriority);
+    }
+}
+
+ObserverStats Device::getObserverStats(DeviceObserver *observer)
+{
+    return m_frameDispatcher->stats(observer);
+}
+
+PipelineStats Device::getPipelineStats()
+{
+    PipelineStats stats = m_latencyTracker->stats();
+    if (m_decoder) {
+        stats.decodeThreads = m_decoder->threadCount();
+        stats.decodeQueue = m_decoder->packetQueueStats();
+    }
+    {
+        QMutexLocker locker(&m_recorderMutex);
+        if (m_recorder) {
+            stats.recordQueue = m_recorder->queueStats();
+            stats.record = m_recorder->outputStats();
+        }
+    }
+    if (m_replayBuffer) {
+        stats.replayBuffer = m_replayBuffer->stats();
+    }
+    return stats;
+}
+
+void Device::resetPipelineStats()
+{
+    m_latencyTracker->reset();
+    if (m_decoder) {
+        m_decoder->resetPacketQueueStats();
+    }
+    {
+        QMutexLocker locker(&m_recorderMutex);
+        if (m_recorder) {
+            m_recorder->resetStats();
+        }
+    }
 }
 
 void Device::showTouch(bool show)
@@ -127,6 +388,78 @@ void Device::showTouch(bool show)
     qInfo() << getSerial() << " show touch " << (show ? "enable" : "disable");
 }
 
+void Device::setConsumptionState(ConsumptionState state)
+{
+    if (state == m_consumptionState) {
+        return;
+    }
+    bool wasHidden = CS_HIDDEN == m_consumptionState;
+    m_consumptionState = state;
+    if (!m_decoder) {
+        return;
+    }
+
+    quint32 maxFps = 0;
+    if (CS_VISIBLE == state) {
+        maxFps = m_params.visibleMaxFps;
+    } else if (CS_THUMBNAIL == state) {
+        maxFps = m_params.thumbnailMaxFps;
+    }
+    m_decoder->setConsumptionState(state, maxFps);
+
+    if (wasHidden && m_controller) {
+        // the decoder skipped the non key frames, resume on a fresh key frame
+        // instead of waiting for the next periodic one
+        m_controller->resetVideo();
+    }
+}
+
+ConsumptionState Device::getConsumptionState()
+{
+    return m_consumptionState;
+}
+
+bool Device::isScreenStable()
+{
+    return m_screenStable;
+}
+
+void Device::onDirtyRegion(const DirtyRegion &region)
+{
+    setScreenStable(false);
+    // no new frame is also no change, so the stable state comes from a timer
+    if (!m_dirtySkipping) {
+        m_stableTimer->start();
+    }
+    for (const auto& item : m_deviceObservers) {
+        item->onDirtyRegion(region);
+    }
+}
+
+void Device::onDirtyDetectionSkipping(bool skipping)
+{
+    m_dirtySkipping = skipping;
+    if (skipping) {
+        // a stretch without frames is not a stable screen
+        m_stableTimer->stop();
+        setScreenStable(false);
+    } else {
+        // the next frames are compared to the last seen change
+        m_stableTimer->start();
+    }
+}
+
+void Device::setScreenStable(bool stable)
+{
+    if (m_screenStable == stable) {
+        return;
+    }
+    m_screenStable = stable;
+    for (const auto& item : m_deviceObservers) {
+        item->onScreenStable(stable);
+    }
+}
+
 bool Device::isReversePort(quint16 port)
 {
     if (m_server && m_server->isReverse() && port == m_server->getParams().localPort) {
@@ -175,26 +508,24 @@ void Device::initSignals()
                 double diff = m_startTimeCount.elapsed() / 1000.0;
                 qInfo() << QString("server start finish in %1s").arg(diff).toStdString().c_str();
 
-                // init recorder
-                if (m_recorder) {
-                    m_recorder->setFrameSize(size);
-                    if (!m_recorder->open()) {
-                        qCritical("Could not open recorder");
-                    }
-
-                    if (!m_recorder->startRecorder()) {
-                        qCritical("Could not start recorder");
-                    }
-                }
-
-                // init decoder
-                if (m_decoder) {
-                    m_decoder->open();
-                }
+                AVCodecID codecId = Demuxer::toAVCodecId(m_server->getCodecId());
+                startPipeline(size, codecId);
 
                 // init stream
+                m_stream->setNativeIngest(m_params.nativeIngest);
                 m_stream->installVideoSocket(m_server->removeVideoSocket());
+                if (!m_params.captureFile.isEmpty()) {
+                    StreamCapture *streamCapture = new StreamCapture(m_params.captureFile);
+                    QByteArray deviceInfo = m_server->getDeviceInfo();
+                    if (streamCapture->open() && streamCapture->writeRecord((const quint8 *)deviceInfo.constData(), deviceInfo.size())) {
+                        m_stream->installStreamCapture(streamCapture);
+                    } else {
+                        qCritical("Could not start stream capture");
+                        delete streamCapture;
+                    }
+                }
                 m_stream->setFrameSize(size);
+                m_stream->setCodecId(codecId);
                 m_stream->startDecode();
 
                 // recv device msg
@@ -235,19 +566,44 @@ void Device::initSignals()
             disconnectDevice();
             qDebug() << "stream thread stop";
         });
-        connect(m_stream, &Demuxer::getFrame, this, [this](AVPacket *packet) {
+        connect(m_stream, &Demuxer::getFrame, this, [this](AVPacket *packet, const NalInfo &nalInfo) {
+            Q_UNUSED(nalInfo)
             if (m_decoder && !m_decoder->push(packet)) {
                 qCritical("Could not send packet to decoder");
             }
 
-            if (m_recorder && !m_recorder->push(packet)) {
+            // the queue may be full, never wait for it under the lock
+            QSharedPointer<Recorder> recorder;
+            {
+                QMutexLocker locker(&m_recorderMutex);
+                recorder = m_recorder;
+            }
+            if (recorder && !recorder->push(packet)) {
                 qCritical("Could not send packet to recorder");
             }
+
+            if (m_replayBuffer) {
+                m_replayBuffer->push(packet);
+            }
         }, Qt::DirectConnection);
         connect(m_stream, &Demuxer::getConfigFrame, this, [this](AVPacket *packet) {
-            if (m_recorder && !m_recorder->push(packet)) {
+            QSharedPointer<Recorder> recorder;
+            {
+                QMutexLocker locker(&m_recorderMutex);
+                // kept for the recordings started later
+                av_packet_unref(m_recordConfig);
+                if (av_packet_ref(m_recordConfig, packet)) {
+                    qCritical("Could not keep config packet");
+                }
+                recorder = m_recorder;
+            }
+            if (recorder && !recorder->push(packet)) {
                 qCritical("Could not send config packet to recorder");
             }
+
+            if (m_replayBuffer) {
+                m_replayBuffer->push(packet);
+            }
         }, Qt::DirectConnection);
     }
 
@@ -260,12 +616,77 @@ void Device::initSignals()
     }
 }
 
+void Device::startPipeline(const QSize &size, AVCodecID codecId)
+{
+    if (AV_CODEC_ID_NONE == codecId) {
+        qWarning("unknown video codec, assume h264");
+        codecId = AV_CODEC_ID_H264;
+    }
+    qInfo("video codec: %s", avcodec_get_name(codecId));
+
+    m_frameSize = size;
+    m_codecId = codecId;
+    {
+        // a new stream starts with its own config packet
+        QMutexLocker locker(&m_recorderMutex);
+        av_packet_unref(m_recordConfig);
+    }
+
+    // init recorder
+    if (m_params.recordFile && !m_params.recordPath.trimmed().isEmpty()) {
+        startRecording("", m_params.recordFileFormat);
+    }
+
+    if (m_replayBuffer) {
+        m_replayBuffer->setStreamInfo(size, codecId);
+    }
+
+    // init decoder
+    if (m_decoder) {
+        m_decoder->open(codecId);
+    }
+}
+
+bool Device::startReplay()
+{
+    StreamReplay *streamReplay = new StreamReplay(m_params.replayFile, m_params.replayRealtime);
+    QByteArray deviceInfo;
+    QString deviceName;
+    QSize size;
+    quint32 codecId = 0;
+    if (!streamReplay->open() || !streamReplay->readDeviceInfo(deviceInfo)
+        || !Server::parseDeviceInfo(deviceInfo, deviceName, size, codecId)) {
+        qCritical("Could not start stream replay");
+        delete streamReplay;
+        emit deviceConnected(false, m_params.serial, "", QSize());
+        return false;
+    }
+
+    m_serverStartSuccess = true;
+    emit deviceConnected(true, m_params.serial, deviceName, size);
+    startPipeline(size, Demuxer::toAVCodecId(codecId));
+
+    m_stream->installReplaySource(streamReplay);
+    m_stream->setFrameSize(size);
+    m_stream->setCodecId(Demuxer::toAVCodecId(codecId));
+    m_stream->startDecode();
+    return true;
+}
+
 bool Device::connectDevice()
 {
     if (!m_server || m_serverStartSuccess) {
         return false;
     }
 
+    if (!m_params.replayFile.isEmpty()) {
+        // no device needed, the stream comes from a capture file
+        QTimer::singleShot(0, this, [this]() {
+            startReplay();
+        });
+        return true;
+    }
+
     // fix: macos cant recv finished signel, timer is ok
     QTimer::singleShot(0, this, [this]() {
         m_startTimeCount.start();
@@ -290,6 +711,12 @@ bool Device::connectDevice()
         params.logLevel = m_params.logLevel;
         params.codecOptions = m_params.codecOptions;
         params.codecName = m_params.codecName;
+        params.videoCodec = m_params.videoCodec;
+        if (m_decoder && !Decoder::isSupported(videoCodecId(params.videoCodec))) {
+            qWarning("video codec %s is not supported by the local decoder, use h264", params.videoCodec.toUtf8().data());
+            params.videoCodec = "h264";
+            params.codecName = "";
+        }
         params.scid = m_params.scid;
 
         params.crop = "";
@@ -316,15 +743,15 @@ void Device::disconnectDevice()
     if (m_decoder) {
         m_decoder->close();
     }
-
-    if (m_recorder) {
-        if (m_recorder->isRunning()) {
-            m_recorder->stopRecorder();
-            m_recorder->wait();
-        }
-        m_recorder->close();
+    if (m_stableTimer) {
+        m_stableTimer->stop();
+        m_dirtySkipping = false;
+        setScreenStable(false);
     }
 
+    // the recorder finishes on the writer thread
+    stopRecording();
+
     if (m_serverStartSuccess) {
         emit deviceDisconnected(m_params.serial);
     }
@@ -603,36 +1030,26 @@ bool Device::isCurrentCustomKeymap()
     return m_controller->isCurrentCustomKeymap();
 }
 
-bool Device::saveFrame(int width, int height, uint8_t* dataRGB32)
+QString Device::saveFilePath(const QString &tag, const QString &suffix)
 {
-    if (!dataRGB32) {
-        return false;
-    }
-
-    QImage rgbImage(dataRGB32, width, height, QImage::Format_RGB32);
-
-    // save
-    QString absFilePath;
     QString fileDir(m_params.recordPath);
     if (fileDir.isEmpty()) {
         qWarning() << "please select record save path!!!";
-        return false;
+        return "";
     }
     QDateTime dateTime = QDateTime::currentDateTime();
     QString fileName = dateTime.toString("_yyyyMMdd_hhmmss_zzz");
-    fileName = m_params.serial + fileName;
+    fileName = m_params.serial + tag + fileName;
     fileName.replace(":", "_");
     fileName.replace(".", "_");
-    fileName += ".png";
+    fileName += "." + suffix;
     QDir dir(fileDir);
-    absFilePath = dir.absoluteFilePath(fileName);
-    int ret = rgbImage.save(absFilePath, "PNG", 100);
-    if (!ret) {
-        return false;
+    if (!dir.exists()) {
+        if (!dir.mkpath(fileDir)) {
+            qCritical() << QString("Failed to create the save folder: %1").arg(fileDir);
+        }
     }
-
-    qInfo() << "screenshot save to " << absFilePath;
-    return true;
+    return dir.absoluteFilePath(fileName);
 }
 
 }
@@ -3,15 +3,24 @@
 
 #include <set>
 #include <QElapsedTimer>
+#include <QMutex>
 #include <QPointer>
+#include <QSharedPointer>
 #include <QTime>
 
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+}
+
 #include "../../include/QtScrcpyCore.h"
 
 class QMouseEvent;
 class QWheelEvent;
 class QKeyEvent;
+class QTimer;
 class Recorder;
+class ReplayBuffer;
 class Server;
 class VideoBuffer;
 class Decoder;
@@ -19,6 +28,9 @@ class FileHandler;
 class Demuxer;
 class VideoForm;
 class Controller;
+class LatencyTracker;
+class DecodeScheduler;
+class FrameDispatcher;
 struct AVFrame;
 
 namespace qsc {
@@ -34,6 +46,7 @@ public:
     void* getUserData() override;
 
     void registerDeviceObserver(DeviceObserver* observer) override;
+    void registerDeviceObserver(DeviceObserver* observer, const ObserverOptions &options) override;
     void deRegisterDeviceObserver(DeviceObserver* observer) override;
 
     bool connectDevice() override;
@@ -65,7 +78,15 @@ public:
     void installApkRequest(const QString &apkFile) override;
 
     void screenshot() override;
+    void screenshot(const ScreenshotOptions &options, std::function<void(const ScreenshotResult &result)> callback) override;
     void showTouch(bool show) override;
+    void setConsumptionState(ConsumptionState state) override;
+    ConsumptionState getConsumptionState() override;
+    bool isScreenStable() override;
+    void saveReplayBuffer(const QString &filePath, std::function<void(bool success, const QString &filePath)> callback) override;
+    bool startRecording(const QString &filePath = "", const QString &format = "") override;
+    void stopRecording() override;
+    bool isRecording() override;
 
     bool isReversePort(quint16 port) override;
     const QString &getSerial() override;
@@ -73,9 +94,22 @@ public:
     void updateScript(QString script) override;
     bool isCurrentCustomKeymap() override;
 
+    PipelineStats getPipelineStats() override;
+    ObserverStats getObserverStats(DeviceObserver* observer) override;
+    void resetPipelineStats() override;
+
+    // shared decode pool, must be set before connectDevice
+    void setDecodeScheduler(DecodeScheduler *scheduler);
+
 private:
     void initSignals();
-    bool saveFrame(int width, int height, uint8_t* dataRGB32);
+    void startPipeline(const QSize &size, AVCodecID codecId);
+    bool startReplay();
+    // <recordPath>/<serial><tag>_<time>.<suffix>
+    QString saveFilePath(const QString &tag, const QString &suffix);
+    void onDirtyRegion(const DirtyRegion &region);
+    void onDirtyDetectionSkipping(bool skipping);
+    void setScreenStable(bool stable);
 
 private:
     // server relevant
@@ -85,11 +119,31 @@ private:
     QPointer<Controller> m_controller;
     QPointer<FileHandler> m_fileHandler;
     QPointer<Demuxer> m_stream;
-    QPointer<Recorder> m_recorder;
+    // the stream thread pushes to the recorder, it can be replaced at runtime:
+    // the stream thread takes a reference under the lock and pushes without it
+    QMutex m_recorderMutex;
+    QSharedPointer<Recorder> m_recorder;
+    // GUI thread, the recordings whose file is not closed yet
+    QList<QSharedPointer<Recorder>> m_recordings;
+    // the last config packet, a recording started later begins with it
+    AVPacket *m_recordConfig = Q_NULLPTR;
+    QSize m_frameSize;
+    AVCodecID m_codecId = AV_CODEC_ID_NONE;
+    // written by the stream thread, kept after the disconnection
+    ReplayBuffer *m_replayBuffer = Q_NULLPTR;
+    // shared with the demuxer/decoder threads
+    LatencyTracker *m_latencyTracker = Q_NULLPTR;
 
     QElapsedTimer m_startTimeCount;
     DeviceParams m_params;
     std::set<DeviceObserver*> m_deviceObservers;
+    FrameDispatcher *m_frameDispatcher = Q_NULLPTR;
+    ConsumptionState m_consumptionState = CS_FOCUSED;
+    // fires screenStableMs after the last dirty region
+    QTimer *m_stableTimer = Q_NULLPTR;
+    bool m_screenStable = false;
+    // only the key frames are decoded, the screen may change unseen
+    bool m_dirtySkipping = false;
     void* m_userData = nullptr;
 };
 
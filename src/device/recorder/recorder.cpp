@@ -1,41 +1,125 @@
 #include <QCoreApplication>
 #include <QDebug>
 #include <QFileInfo>
+#include <QTimer>
 
 #include "compat.h"
+#include "packetqueue.h"
 #include "recorder.h"
 
 static const AVRational SCRCPY_TIME_BASE = { 1, 1000000 }; // timestamps in us
 
-Recorder::Recorder(const QString &fileName, QObject *parent) : QThread(parent), m_fileName(fileName), m_format(guessRecordFormat(fileName)) {}
-
-Recorder::~Recorder() {}
+// the writer is scheduled for every RECORDER_WAKEUP_BATCH packets, a file
+// does not need the packets as soon as they arrive
+#define RECORDER_WAKEUP_BATCH 8
+// but no packet waits longer than that for the rest of its batch: a static
+// screen sends no frames, the last change must reach the file anyway
+#define RECORDER_WAKEUP_MAX_DELAY_MS 250
+#define RECORDER_FLUSH_TICK_MS 100
+// packets written per turn, then the other recordings get the writer
+#define RECORDER_WRITE_BATCH 32
+
+// writer pool shared by all the recordings, created with the first one
+static QMutex s_writerMutex;
+static int s_writerThreads = 2;
+static DecodeScheduler *s_writer = Q_NULLPTR;
+
+static DecodeScheduler *writerScheduler()
+{
+    QMutexLocker locker(&s_writerMutex);
+    if (!s_writer) {
+        // the strand scheduler of the decode pool: a recording never runs on
+        // two writers at a time, an idle writer steals the others' work
+        // never deleted, a recording may be stopped until the very end
+        s_writer = new DecodeScheduler(s_writerThreads);
+    }
+    return s_writer;
+}
 
-AVPacket *Recorder::packetNew(const AVPacket *packet)
+QSize Recorder::parseFrameSize(AVCodecID codecId, const AVPacket *config, const AVPacket *keyFrame)
 {
-    AVPacket *rec = av_packet_alloc();
-    if (!rec) {
-        return Q_NULLPTR;
+    // the parser reports the size of the SPS once it saw a slice
+    QSize frameSize;
+    AVCodecParserContext *parser = av_parser_init(codecId);
+    if (!parser) {
+        return frameSize;
+    }
+    AVCodecContext *codecCtx = avcodec_alloc_context3(Q_NULLPTR);
+    // one access unit, parsed as is
+    int size = config->size + keyFrame->size;
+    uint8_t *data = static_cast<uint8_t *>(av_malloc(size + AV_INPUT_BUFFER_PADDING_SIZE));
+    if (codecCtx && data) {
+        memcpy(data, config->data, config->size);
+        memcpy(data + config->size, keyFrame->data, keyFrame->size);
+        memset(data + size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+        uint8_t *out = Q_NULLPTR;
+        int outSize = 0;
+        av_parser_parse2(parser, codecCtx, &out, &outSize, data, size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, -1);
+        if (parser->width > 0 && parser->height > 0) {
+            frameSize = QSize(parser->width, parser->height);
+        }
     }
+    av_free(data);
+    avcodec_free_context(&codecCtx);
+    av_parser_close(parser);
+    return frameSize;
+}
 
-    if (av_packet_ref(rec, packet)) {
-        delete rec;
-        return Q_NULLPTR;
+bool Recorder::setWriterThreads(int threads)
+{
+    QMutexLocker locker(&s_writerMutex);
+    if (s_writer) {
+        return false;
     }
-    return rec;
+    s_writerThreads = qMax(1, threads);
+    return true;
 }
 
-void Recorder::packetDelete(AVPacket *packet)
+Recorder::Recorder(const QString &fileName, QObject *parent)
+    : QObject(parent), m_fileName(fileName), m_format(guessRecordFormat(fileName)), m_failed(false), m_unscheduled(0), m_firstUnscheduledMs(0),
+      m_schedules(0), m_syncRequested(false)
 {
-    av_packet_unref(packet);
-    av_packet_free(&packet);
+    m_packet = av_packet_alloc();
+    m_previous = av_packet_alloc();
+    m_config = av_packet_alloc();
 }
 
-void Recorder::queueClear()
+Recorder::~Recorder()
 {
-    while (!m_queue.isEmpty()) {
-        packetDelete(m_queue.dequeue());
+    if (m_strand) {
+        stopRecorder();
+        waitStopped();
+        m_writer->removeStrand(m_strand);
+        m_strand = Q_NULLPTR;
+    } else {
+        // opened but never started
+        closeFile();
     }
+    if (m_queue) {
+        delete m_queue;
+        m_queue = Q_NULLPTR;
+    }
+    av_packet_free(&m_packet);
+    av_packet_free(&m_previous);
+    av_packet_free(&m_config);
+}
+
+Recorder::RecorderFormat Recorder::formatFromName(const QString &name)
+{
+    if (0 == name.compare("mp4")) {
+        return Recorder::RECORDER_FORMAT_MP4;
+    }
+    if (0 == name.compare("mkv")) {
+        return Recorder::RECORDER_FORMAT_MKV;
+    }
+    return Recorder::RECORDER_FORMAT_NULL;
+}
+
+void Recorder::setQueue(int capacity, bool dropUntilKeyFrame)
+{
+    m_queueCapacity = qMax(RECORDER_WAKEUP_BATCH, capacity);
+    m_queueDropUntilKeyFrame = dropUntilKeyFrame;
 }
 
 void Recorder::setFrameSize(const QSize &declaredFrameSize)
@@ -43,20 +127,43 @@ void Recorder::setFrameSize(const QSize &declaredFrameSize)
     m_declaredFrameSize = declaredFrameSize;
 }
 
+void Recorder::setCodecId(AVCodecID codecId)
+{
+    m_codecId = codecId;
+}
+
 void Recorder::setFormat(Recorder::RecorderFormat format)
 {
     m_format = format;
 }
 
+void Recorder::setSegment(quint32 seconds, quint32 megabytes)
+{
+    m_segmentSeconds = seconds;
+    m_segmentMegabytes = megabytes;
+}
+
+void Recorder::setOutput(int bufferSize, qsc::RecordSyncPolicy syncPolicy, quint32 syncSeconds)
+{
+    m_output.setBufferSize(bufferSize);
+    m_output.setSyncPolicy(syncPolicy);
+    m_syncPeriodMs = qsc::RSP_PERIODIC == syncPolicy ? qMax(1u, syncSeconds) * 1000LL : 0;
+}
+
+void Recorder::setFragmented(bool fragmented)
+{
+    m_fragmented = fragmented;
+}
+
 bool Recorder::open()
 {
-    // codec
-    const AVCodec* inputCodec = avcodec_find_decoder(AV_CODEC_ID_H264);
-    if (!inputCodec) {
-        qCritical("H.264 decoder not found");
-        return false;
-    }
+    m_segmentIndex = 1;
+    return openFile(segmentFileName());
+}
 
+bool Recorder::openFile(const QString &fileName)
+{
+    m_currentFileName = fileName;
     QString formatName = recorderGetFormatName(m_format);
     Q_ASSERT(!formatName.isEmpty());
     const AVOutputFormat *format = findMuxer(formatName.toUtf8());
@@ -81,7 +188,8 @@ bool Recorder::open()
     QString comment = "Recorded by QtScrcpy " + QCoreApplication::applicationVersion();
     av_dict_set(&m_formatCtx->metadata, "comment", comment.toUtf8(), 0);
 
-    AVStream *outStream = avformat_new_stream(m_formatCtx, inputCodec);
+    // no decoder needed, the packets are muxed as is
+    AVStream *outStream = avformat_new_stream(m_formatCtx, Q_NULLPTR);
     if (!outStream) {
         avformat_free_context(m_formatCtx);
         m_formatCtx = Q_NULLPTR;
@@ -90,77 +198,149 @@ bool Recorder::open()
 
 #ifdef QTSCRCPY_LAVF_HAS_NEW_CODEC_PARAMS_API
     outStream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
-    outStream->codecpar->codec_id = inputCodec->id;
+    outStream->codecpar->codec_id = m_codecId;
     outStream->codecpar->format = AV_PIX_FMT_YUV420P;
     outStream->codecpar->width = m_declaredFrameSize.width();
     outStream->codecpar->height = m_declaredFrameSize.height();
 #else
     outStream->codec->codec_type = AVMEDIA_TYPE_VIDEO;
-    outStream->codec->codec_id = inputCodec->id;
+    outStream->codec->codec_id = m_codecId;
     outStream->codec->pix_fmt = AV_PIX_FMT_YUV420P;
     outStream->codec->width = m_declaredFrameSize.width();
     outStream->codec->height = m_declaredFrameSize.height();
 #endif
 
-    int ret = avio_open(&m_formatCtx->pb, m_fileName.toUtf8().toStdString().c_str(), AVIO_FLAG_WRITE);
-    if (ret < 0) {
-        char errorbuf[255] = { 0 };
-        av_strerror(ret, errorbuf, 254);
-        qCritical() << QString("Failed to open output file: %1 %2").arg(errorbuf).arg(m_fileName).toUtf8().toStdString().c_str();
+    if (!m_output.open(m_currentFileName)) {
         // ostream will be cleaned up during context cleaning
         avformat_free_context(m_formatCtx);
         m_formatCtx = Q_NULLPTR;
         return false;
     }
+    m_formatCtx->pb = m_output.avio();
+    m_formatCtx->flags |= AVFMT_FLAG_CUSTOM_IO;
+    // by default the muxer flushes the buffer after every packet
+    m_formatCtx->flush_packets = 0;
 
     return true;
 }
 
 void Recorder::close()
+{
+    closeFile();
+}
+
+void Recorder::closeFile()
 {
     if (Q_NULLPTR != m_formatCtx) {
+        bool ok = m_headerWritten;
         if (m_headerWritten) {
             int ret = av_write_trailer(m_formatCtx);
             if (ret < 0) {
-                qCritical() << QString("Failed to write trailer to %1").arg(m_fileName).toUtf8().toStdString().c_str();
-                m_failed = true;
-            } else {
-                qInfo() << QString("success record %1").arg(m_fileName).toStdString().c_str();
+                qCritical() << QString("Failed to write trailer to %1").arg(m_currentFileName).toUtf8().toStdString().c_str();
+                ok = false;
             }
+        }
+        // the end of the file is still in the buffer
+        if (!m_output.close() && m_headerWritten) {
+            qCritical() << QString("Failed to write %1").arg(m_currentFileName).toUtf8().toStdString().c_str();
+            ok = false;
+        }
+        if (ok) {
+            qInfo() << QString("success record %1").arg(m_currentFileName).toStdString().c_str();
         } else {
-            // the recorded file is empty
+            // an empty file is a failure too
             m_failed = true;
         }
-        avio_close(m_formatCtx->pb);
         avformat_free_context(m_formatCtx);
         m_formatCtx = Q_NULLPTR;
     }
+    m_headerWritten = false;
+}
+
+QString Recorder::segmentFileName()
+{
+    if (!m_segmentSeconds && !m_segmentMegabytes) {
+        return m_fileName;
+    }
+    QFileInfo fileInfo(m_fileName);
+    return QString("%1/%2_%3.%4").arg(fileInfo.path()).arg(fileInfo.completeBaseName()).arg(m_segmentIndex, 3, 10, QChar('0')).arg(fileInfo.suffix());
+}
+
+bool Recorder::shouldRotate(const AVPacket *packet)
+{
+    // a segment must start on a key frame to be playable on its own
+    if (!m_headerWritten || !(packet->flags & AV_PKT_FLAG_KEY)) {
+        return false;
+    }
+    if (m_rotatePending) {
+        return true;
+    }
+    // rounded to the closest frame, 120 frames at 60 fps are 1999920 us
+    if (m_segmentSeconds && AV_NOPTS_VALUE != m_segmentStartPts
+        && packet->pts - m_segmentStartPts + packet->duration / 2 >= m_segmentSeconds * 1000000LL) {
+        return true;
+    }
+    if (m_segmentMegabytes && avio_tell(m_formatCtx->pb) >= m_segmentMegabytes * 1024LL * 1024LL) {
+        return true;
+    }
+    return false;
+}
+
+bool Recorder::rotate(const AVPacket *keyFrame)
+{
+    closeFile();
+    m_segmentIndex++;
+    if (!openFile(segmentFileName())) {
+        return false;
+    }
+    // every segment starts with the config packet
+    if (!recorderWriteHeader(m_config, keyFrame)) {
+        return false;
+    }
+    m_headerWritten = true;
+    m_rotatePending = false;
+    return true;
 }
 
 bool Recorder::write(AVPacket *packet)
 {
+    if (packet->pts == AV_NOPTS_VALUE) {
+        // config packet, the headers are written with the next key frame
+        bool changed = m_config->size != packet->size || (packet->size && memcmp(m_config->data, packet->data, packet->size));
+        if (changed) {
+            av_packet_unref(m_config);
+            if (av_packet_ref(m_config, packet)) {
+                return false;
+            }
+        }
+        if (m_headerWritten && changed && (m_segmentSeconds || m_segmentMegabytes)) {
+            // the new stream (e.g. rotated) gets its own segment
+            m_rotatePending = true;
+        }
+        return true;
+    }
+
     if (!m_headerWritten) {
-        if (packet->pts != AV_NOPTS_VALUE) {
+        if (!m_config->size) {
             qCritical("The first packet is not a config packet");
             return false;
         }
-        bool ok = recorderWriteHeader(packet);
-        if (!ok) {
+        // written with the first frame, which tells the frame size of the config
+        if (!recorderWriteHeader(m_config, packet)) {
             return false;
         }
         m_headerWritten = true;
-        return true;
-    }
-
-    if (packet->pts == AV_NOPTS_VALUE) {
-        // ignore config packets
-        return true;
     }
 
     recorderRescalePacket(packet);
     return av_write_frame(m_formatCtx, packet) >= 0;
 }
 
+bool Recorder::failed()
+{
+    return m_failed.load();
+}
+
 const AVOutputFormat *Recorder::findMuxer(const char *name)
 {
 #ifdef QTSCRCPY_LAVF_HAS_NEW_MUXER_ITERATOR_API
@@ -178,7 +358,7 @@ const AVOutputFormat *Recorder::findMuxer(const char *name)
     return outFormat;
 }
 
-bool Recorder::recorderWriteHeader(const AVPacket *packet)
+bool Recorder::recorderWriteHeader(const AVPacket *packet, const AVPacket *keyFrame)
 {
     AVStream *ostream = m_formatCtx->streams[0];
     quint8 *extradata = (quint8 *)av_malloc(packet->size * sizeof(quint8));
@@ -189,15 +369,36 @@ bool Recorder::recorderWriteHeader(const AVPacket *packet)
     // copy the first packet to the extra data
     memcpy(extradata, packet->data, packet->size);
 
+    // the size given by the device is stale after a rotation, the SPS is not
+    if (keyFrame->flags & AV_PKT_FLAG_KEY) {
+        QSize frameSize = parseFrameSize(m_codecId, packet, keyFrame);
+        if (frameSize.isValid()) {
+            m_declaredFrameSize = frameSize;
+        }
+    }
+
 #ifdef QTSCRCPY_LAVF_HAS_NEW_CODEC_PARAMS_API
     ostream->codecpar->extradata = extradata;
     ostream->codecpar->extradata_size = packet->size;
+    ostream->codecpar->width = m_declaredFrameSize.width();
+    ostream->codecpar->height = m_declaredFrameSize.height();
 #else
     ostream->codec->extradata = extradata;
     ostream->codec->extradata_size = packet->size;
+    ostream->codec->width = m_declaredFrameSize.width();
+    ostream->codec->height = m_declaredFrameSize.height();
 #endif
 
-    int ret = avformat_write_header(m_formatCtx, NULL);
+    AVDictionary *options = Q_NULLPTR;
+    if (m_fragmented && RECORDER_FORMAT_MP4 == m_format) {
+        // a fragment per key frame, and at least every second, the moov is
+        // written first: the file is playable at any time and the trailer
+        // rewrites nothing
+        av_dict_set(&options, "movflags", "frag_keyframe+empty_moov+default_base_moof", 0);
+        av_dict_set(&options, "frag_duration", "1000000", 0);
+    }
+    int ret = avformat_write_header(m_formatCtx, &options);
+    av_dict_free(&options);
     if (ret < 0) {
         qCritical("Failed to write header recorder file");
         return false;
@@ -229,117 +430,230 @@ Recorder::RecorderFormat Recorder::guessRecordFormat(const QString &fileName)
         return Recorder::RECORDER_FORMAT_NULL;
     }
     QFileInfo fileInfo = QFileInfo(fileName);
-    QString ext = fileInfo.suffix();
-    if (0 == ext.compare("mp4")) {
-        return Recorder::RECORDER_FORMAT_MP4;
-    }
-    if (0 == ext.compare("mkv")) {
-        return Recorder::RECORDER_FORMAT_MKV;
-    }
-
-    return Recorder::RECORDER_FORMAT_NULL;
+    return formatFromName(fileInfo.suffix());
 }
 
-void Recorder::run()
+bool Recorder::writePending(int maxPackets)
 {
-    qint64 ptsOrigin = AV_NOPTS_VALUE;
-    for (;;) {
-        AVPacket *rec = Q_NULLPTR;
-        {
-            QMutexLocker locker(&m_mutex);
-            while (!m_stopped && m_queue.isEmpty()) {
-                m_recvDataCond.wait(&m_mutex);
+    // runs on the writer thread, never concurrently
+    for (int i = 0; i < maxPackets; i++) {
+        if (!m_queue->pop(m_packet, false)) {
+            if (m_queue->isFinished()) {
+                finishRecording();
+            } else {
+                syncIfRequested();
             }
+            return false;
+        }
+        if (!writePacket(m_packet)) {
+            qCritical("Could not record packet");
+            m_failed.store(true);
+            // discard pending packets, and never block the stream thread anymore
+            m_queue->interrupt();
+            finishRecording();
+            return false;
+        }
+    }
+    syncIfRequested();
+    // come back even if empty, a stop may be pending
+    return true;
+}
 
-            // if stopped is set, continue to process the remaining events (to
-            // finish the recording) before actually stopping
-            if (m_stopped && m_queue.isEmpty()) {
-                AVPacket *last = m_previous;
-                if (last) {
-                    last->pts -= ptsOrigin;
-                    last->dts = last->pts;
-                    // assign an arbitrary duration to the last packet
-                    last->duration = 100000;
-                    bool ok = write(last);
-                    if (!ok) {
-                        // failing to write the last frame is not very serious, no
-                        // future frame may depend on it, so the resulting file
-                        // will still be valid
-                        qWarning("Could not record last packet");
-                    }
-                    packetDelete(last);
-                }
-                break;
-            }
+void Recorder::syncIfRequested()
+{
+    if (m_syncRequested.exchange(false)) {
+        m_output.syncPeriodic();
+    }
+}
 
-            rec = m_queue.dequeue();
-        }
+bool Recorder::writePacket(AVPacket *packet)
+{
+    if (!m_hasPrevious) {
+        // we just received the first packet
+        av_packet_move_ref(m_previous, packet);
+        m_hasPrevious = true;
+        return true;
+    }
 
-        // recorder->previous is only written from this thread, no need to lock
-        AVPacket *previous = m_previous;
-        m_previous = rec;
+    AVPacket *previous = m_previous;
 
-        if (!previous) {
-            // we just received the first packet
-            continue;
-        }
+    // config packets have no PTS, we must ignore them
+    if (packet->pts != AV_NOPTS_VALUE && previous->pts != AV_NOPTS_VALUE) {
+        // we now know the duration of the previous packet
+        previous->duration = packet->pts - previous->pts;
+    }
 
-        // config packets have no PTS, we must ignore them
-        if (rec->pts != AV_NOPTS_VALUE && previous->pts != AV_NOPTS_VALUE) {
-            // we now know the duration of the previous packet
-            previous->duration = rec->pts - previous->pts;
+    bool ok = true;
+    if (previous->pts != AV_NOPTS_VALUE) {
+        if (shouldRotate(previous)) {
+            ok = rotate(previous);
+            // each segment starts at 0
+            m_ptsOrigin = AV_NOPTS_VALUE;
+        }
+        if (m_ptsOrigin == AV_NOPTS_VALUE) {
+            m_ptsOrigin = previous->pts;
+            m_segmentStartPts = m_ptsOrigin;
         }
+        previous->pts -= m_ptsOrigin;
+        previous->dts = previous->pts;
+    }
 
-        if (previous->pts != AV_NOPTS_VALUE) {
-            if (ptsOrigin == AV_NOPTS_VALUE) {
-                ptsOrigin = previous->pts;
-            }
-            previous->pts -= ptsOrigin;
-            previous->dts = previous->pts;
-        }        
+    ok = ok && write(previous);
+    av_packet_unref(previous);
+    // the current packet becomes the previous one, the blank shell is reused
+    m_previous = packet;
+    m_packet = previous;
+    return ok;
+}
 
-        bool ok = write(previous);
-        packetDelete(previous);
-        if (!ok) {
-            qCritical("Could not record packet");
-            QMutexLocker locker(&m_mutex);
-            m_failed = true;
-            // discard pending packets
-            queueClear();
-            break;
+void Recorder::finishRecording()
+{
+    {
+        QMutexLocker locker(&m_stoppedMutex);
+        if (m_stopped) {
+            return;
+        }
+    }
+    // finish the recording with the last packet
+    if (m_hasPrevious) {
+        AVPacket *last = m_previous;
+        if (!m_failed.load()) {
+            last->pts -= m_ptsOrigin;
+            last->dts = last->pts;
+            // assign an arbitrary duration to the last packet
+            last->duration = 100000;
+            bool ok = write(last);
+            if (!ok) {
+                // failing to write the last frame is not very serious, no
+                // future frame may depend on it, so the resulting file
+                // will still be valid
+                qWarning("Could not record last packet");
+            }
         }
+        av_packet_unref(last);
+        m_hasPrevious = false;
     }
+    closeFile();
+    bool success = !m_failed.load();
 
-    qDebug("Recorder thread ended");
+    {
+        QMutexLocker locker(&m_stoppedMutex);
+        m_stopped = true;
+        m_stoppedCond.wakeAll();
+    }
+    qDebug("Recorder stopped");
+    emit recordStopped(success);
 }
 
 bool Recorder::startRecorder()
 {
-    start();
+    if (!m_packet || !m_previous || m_strand) {
+        return false;
+    }
+    if (!m_queue) {
+        m_queue = new PacketQueue(m_queueCapacity,
+                                  m_queueDropUntilKeyFrame ? PacketQueue::OVERFLOW_DROP_UNTIL_KEY_FRAME : PacketQueue::OVERFLOW_BLOCK);
+    }
+    m_writer = writerScheduler();
+    m_strand = m_writer->addStrand([this](int maxPackets) { return writePending(maxPackets); }, RECORDER_WRITE_BATCH);
+    m_clock.start();
+    m_flushTimer = new QTimer(this);
+    m_flushTimer->setInterval(RECORDER_FLUSH_TICK_MS);
+    connect(m_flushTimer, &QTimer::timeout, this, &Recorder::onFlushTick);
+    m_flushTimer->start();
     return true;
 }
 
+void Recorder::onFlushTick()
+{
+    qint64 now = m_clock.elapsed();
+    // the write-behind buffer reaches the disk even if no packet comes
+    if (m_syncPeriodMs && now - m_lastSyncRequestMs >= m_syncPeriodMs) {
+        m_lastSyncRequestMs = now;
+        m_syncRequested.store(true);
+        scheduleWriter();
+        return;
+    }
+    if (m_unscheduled.load() && now - m_firstUnscheduledMs.load() >= RECORDER_WAKEUP_MAX_DELAY_MS) {
+        scheduleWriter();
+    }
+}
+
+void Recorder::scheduleWriter()
+{
+    // a race with the other thread only schedules once more
+    m_unscheduled.store(0);
+    m_schedules++;
+    m_writer->schedule(m_strand);
+}
+
 void Recorder::stopRecorder()
 {
-    QMutexLocker locker(&m_mutex);
-    m_stopped = true;
-    m_recvDataCond.wakeOne();
+    if (m_flushTimer) {
+        m_flushTimer->stop();
+    }
+    if (m_queue && m_strand) {
+        // the queued packets are still recorded
+        m_queue->finish();
+        m_writer->schedule(m_strand);
+    }
+}
+
+void Recorder::waitStopped()
+{
+    QMutexLocker locker(&m_stoppedMutex);
+    while (!m_stopped) {
+        m_stoppedCond.wait(&m_stoppedMutex);
+    }
 }
 
 bool Recorder::push(const AVPacket *packet)
 {
-    QMutexLocker locker(&m_mutex);
-    Q_ASSERT(!m_stopped);
-
-    if (m_failed) {
+    if (m_failed.load() || !m_strand) {
         // reject any new packet (this will stop the stream)
         return false;
     }
+    bool config = AV_NOPTS_VALUE == packet->pts;
+    if (!config && m_waitKeyFrame) {
+        if (!(packet->flags & AV_PKT_FLAG_KEY)) {
+            // undecodable without the previous packets
+            return true;
+        }
+        m_waitKeyFrame = false;
+    }
+    // a dropped packet (queue full) is counted in the queue stats
+    m_queue->push(packet);
+    int unscheduled = m_unscheduled.fetch_add(1);
+    if (!unscheduled) {
+        // the flush timer schedules the writer if the batch stays incomplete
+        m_firstUnscheduledMs.store(m_clock.elapsed());
+    }
+    if (unscheduled + 1 >= RECORDER_WAKEUP_BATCH || config) {
+        scheduleWriter();
+    }
+    return true;
+}
+
+qsc::PacketQueueStats Recorder::queueStats()
+{
+    if (!m_queue) {
+        return qsc::PacketQueueStats();
+    }
+    qsc::PacketQueueStats stats = m_queue->stats();
+    stats.wakeups = m_schedules.load();
+    return stats;
+}
 
-    AVPacket *rec = packetNew(packet);
-    if (rec) {
-        m_queue.enqueue(rec);
-        m_recvDataCond.wakeOne();
+qsc::RecordStats Recorder::outputStats()
+{
+    return m_output.stats();
+}
+
+void Recorder::resetStats()
+{
+    if (m_queue) {
+        m_queue->resetStats();
     }
-    return rec != Q_NULLPTR;
+    m_schedules.store(0);
+    m_output.resetStats();
 }
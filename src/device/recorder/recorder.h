@@ -1,18 +1,30 @@
 #ifndef RECORDER_H
 #define RECORDER_H
+#include <atomic>
+
+#include <QElapsedTimer>
 #include <QMutex>
-#include <QQueue>
+#include <QObject>
 #include <QSize>
 #include <QString>
-#include <QThread>
 #include <QWaitCondition>
 
+#include "../../../include/QtScrcpyCoreDef.h"
+#include "decodescheduler.h"
+#include "recordoutput.h"
+
 extern "C"
 {
 #include "libavformat/avformat.h"
 }
 
-class Recorder : public QThread
+class PacketQueue;
+class QTimer;
+
+// Muxes the packets of a device to a file. A recorder has no thread of its
+// own: all the recordings are strands of a small shared writer pool, and the
+// stream thread only queues the packets.
+class Recorder : public QObject
 {
     Q_OBJECT
 public:
@@ -24,48 +36,125 @@ public:
     };
 
     Recorder(const QString &fileName, QObject *parent = Q_NULLPTR);
+    // a started recorder is stopped, and waits for its packets to be written
     virtual ~Recorder();
 
+    // "mp4"/"mkv", RECORDER_FORMAT_NULL if not supported
+    static RecorderFormat formatFromName(const QString &name);
+    // size of the writer pool, false once the first recording started
+    static bool setWriterThreads(int threads);
+    // frame size in the config packet, invalid if it could not be parsed
+    static QSize parseFrameSize(AVCodecID codecId, const AVPacket *config, const AVPacket *keyFrame);
+
     void setFrameSize(const QSize &declaredFrameSize);
+    void setCodecId(AVCodecID codecId);
     void setFormat(Recorder::RecorderFormat format);
+    // bounded packet queue, must be called before startRecorder()
+    void setQueue(int capacity, bool dropUntilKeyFrame);
+    // roll to a new file every seconds/megabytes (0: no limit), on a key frame
+    // the files are named <name>_001.<ext>, <name>_002.<ext>... must be called before open()
+    void setSegment(quint32 seconds, quint32 megabytes);
+    // mp4 only: fragmented mp4, the file is playable at any time
+    void setFragmented(bool fragmented);
+    // write-behind buffer and sync policy of the files, must be called before open()
+    void setOutput(int bufferSize, qsc::RecordSyncPolicy syncPolicy, quint32 syncSeconds);
     bool open();
     void close();
     bool write(AVPacket *packet);
+    // a packet, the header or the trailer could not be written
+    bool failed();
+    // from now on the pushed packets are written by the shared writer thread
+    // the calling thread must run an event loop (flush timer)
     bool startRecorder();
+    // does not block: the queued packets are written, then the file is closed
+    // and recordStopped() is emitted, from the writer thread
     void stopRecorder();
+    void waitStopped();
+    // stream thread, never allocates nor takes a lock (except to schedule the
+    // writer once per batch, or after RECORDER_WAKEUP_MAX_DELAY_MS)
+    // the data packets before the first key frame are skipped, so that a
+    // recording can start in the middle of a stream (after the config packet)
     bool push(const AVPacket *packet);
+    qsc::PacketQueueStats queueStats();
+    qsc::RecordStats outputStats();
+    void resetStats();
+
+signals:
+    void recordStopped(bool success);
+
+private slots:
+    // schedules the writer for the packets of an incomplete batch, and for
+    // the RSP_PERIODIC syncs
+    void onFlushTick();
 
 private:
+    // stream thread or flush timer
+    void scheduleWriter();
+    // writer thread
+    bool writePending(int maxPackets);
+    bool writePacket(AVPacket *packet);
+    void syncIfRequested();
+    void finishRecording();
     const AVOutputFormat *findMuxer(const char *name);
-    bool recorderWriteHeader(const AVPacket *packet);
+    bool openFile(const QString &fileName);
+    void closeFile();
+    QString segmentFileName();
+    bool shouldRotate(const AVPacket *packet);
+    bool rotate(const AVPacket *keyFrame);
+    // keyFrame: the first packet of the file, the frame size is read from it
+    bool recorderWriteHeader(const AVPacket *packet, const AVPacket *keyFrame);
     void recorderRescalePacket(AVPacket *packet);
     QString recorderGetFormatName(Recorder::RecorderFormat format);
     RecorderFormat guessRecordFormat(const QString &fileName);
 
-private:
-    AVPacket *packetNew(const AVPacket *packet);
-    void packetDelete(AVPacket *packet);
-    void queueClear();
-
-protected:
-    void run();
-
 private:
     QString m_fileName = "";
+    // the file being written, a segment of m_fileName in segmented mode
+    QString m_currentFileName = "";
     AVFormatContext *m_formatCtx = Q_NULLPTR;
+    RecordOutput m_output;
     QSize m_declaredFrameSize;
+    AVCodecID m_codecId = AV_CODEC_ID_H264;
     bool m_headerWritten = false;
     RecorderFormat m_format = RECORDER_FORMAT_NULL;
-    QMutex m_mutex;
-    QWaitCondition m_recvDataCond;
-    bool m_stopped = false; // set on recorder_stop() by the stream reader
-    bool m_failed = false;  // set on packet write failure
-    QQueue<AVPacket *> m_queue;
+    std::atomic<bool> m_failed; // set on packet write failure
+    bool m_fragmented = false;
+    quint32 m_segmentSeconds = 0;
+    quint32 m_segmentMegabytes = 0;
+    // writer thread only
+    int m_segmentIndex = 0;
+    qint64 m_segmentStartPts = AV_NOPTS_VALUE;
+    // the last config packet, it starts every segment
+    AVPacket *m_config = Q_NULLPTR;
+    // the config changed (e.g. rotation), start a new segment
+    bool m_rotatePending = false;
+    int m_queueCapacity = 256;
+    bool m_queueDropUntilKeyFrame = true;
+    PacketQueue *m_queue = Q_NULLPTR;
+    DecodeScheduler *m_writer = Q_NULLPTR;
+    DecodeScheduler::Strand *m_strand = Q_NULLPTR;
+    // stream thread only
+    bool m_waitKeyFrame = true;
+    // packets pushed since the writer was last scheduled, and when the first one came
+    std::atomic<int> m_unscheduled;
+    std::atomic<qint64> m_firstUnscheduledMs;
+    std::atomic<quint64> m_schedules;
+    QElapsedTimer m_clock;
+    QTimer *m_flushTimer = Q_NULLPTR;
+    // RSP_PERIODIC sync period, 0 otherwise, the flush timer requests the syncs
+    qint64 m_syncPeriodMs = 0;
+    qint64 m_lastSyncRequestMs = 0;
+    std::atomic<bool> m_syncRequested;
     // we can write a packet only once we received the next one so that we can
     // set its duration (next_pts - current_pts)
-    // "previous" is only accessed from the recorder thread, so it does not
-    // need to be protected by the mutex
+    // both shells are only accessed from the writer thread
+    AVPacket *m_packet = Q_NULLPTR;
     AVPacket *m_previous = Q_NULLPTR;
+    bool m_hasPrevious = false;
+    qint64 m_ptsOrigin = AV_NOPTS_VALUE;
+    QMutex m_stoppedMutex;
+    QWaitCondition m_stoppedCond;
+    bool m_stopped = false;
 };
 
 #endif // RECORDER_H
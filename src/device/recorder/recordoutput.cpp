@@ -0,0 +1,161 @@
+#include <QDebug>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "recordoutput.h"
+
+extern "C"
+{
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+}
+
+// the muxer writes are small (a packet, a box header...)
+#define RECORD_OUTPUT_MIN_BUFFER (4 * 1024)
+#define RECORD_OUTPUT_MAX_BUFFER (64 * 1024 * 1024)
+
+RecordOutput::RecordOutput() : m_bytes(0), m_writes(0), m_syncs(0) {}
+
+RecordOutput::~RecordOutput()
+{
+    close();
+}
+
+void RecordOutput::setBufferSize(int bytes)
+{
+    m_bufferSize = qBound(RECORD_OUTPUT_MIN_BUFFER, bytes, RECORD_OUTPUT_MAX_BUFFER);
+}
+
+void RecordOutput::setSyncPolicy(qsc::RecordSyncPolicy policy)
+{
+    m_syncPolicy = policy;
+}
+
+bool RecordOutput::open(const QString &fileName)
+{
+    close();
+    m_file.setFileName(fileName);
+    // the AVIOContext is the buffer
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Unbuffered)) {
+        qCritical() << QString("Failed to open output file: %1").arg(fileName).toUtf8().toStdString().c_str();
+        return false;
+    }
+    unsigned char *buffer = static_cast<unsigned char *>(av_malloc(m_bufferSize));
+    if (!buffer) {
+        m_file.close();
+        return false;
+    }
+    m_avio = avio_alloc_context(buffer, m_bufferSize, 1, this, Q_NULLPTR, writePacket, seek);
+    if (!m_avio) {
+        av_free(buffer);
+        m_file.close();
+        return false;
+    }
+    return true;
+}
+
+bool RecordOutput::close()
+{
+    if (!m_avio) {
+        return true;
+    }
+    avio_flush(m_avio);
+    // the write errors of the flushes, this one and the muxer ones
+    bool ok = !m_avio->error;
+    if (qsc::RSP_NONE != m_syncPolicy && !sync()) {
+        ok = false;
+    }
+    // the context may have reallocated its buffer
+    av_freep(&m_avio->buffer);
+    avio_context_free(&m_avio);
+    m_file.close();
+    return ok;
+}
+
+AVIOContext *RecordOutput::avio()
+{
+    return m_avio;
+}
+
+void RecordOutput::syncPeriodic()
+{
+    if (!m_avio || qsc::RSP_PERIODIC != m_syncPolicy) {
+        return;
+    }
+    // what is still in the buffer would not be on the disk
+    avio_flush(m_avio);
+    sync();
+}
+
+bool RecordOutput::sync()
+{
+#ifdef Q_OS_WIN
+    int ret = _commit(m_file.handle());
+#else
+    int ret = fsync(m_file.handle());
+#endif
+    if (ret) {
+        qWarning() << "Failed to sync" << m_file.fileName();
+        return false;
+    }
+    m_syncs++;
+    return true;
+}
+
+qsc::RecordStats RecordOutput::stats()
+{
+    qsc::RecordStats stats;
+    stats.bytesWritten = m_bytes.load();
+    stats.writes = m_writes.load();
+    stats.syncs = m_syncs.load();
+    return stats;
+}
+
+void RecordOutput::resetStats()
+{
+    m_bytes.store(0);
+    m_writes.store(0);
+    m_syncs.store(0);
+}
+
+int RecordOutput::writePacket(void *opaque, uint8_t *buf, int size)
+{
+    RecordOutput *output = static_cast<RecordOutput *>(opaque);
+    if (output->m_file.write(reinterpret_cast<const char *>(buf), size) != size) {
+        return AVERROR(EIO);
+    }
+    output->m_bytes += size;
+    output->m_writes++;
+    return size;
+}
+
+int64_t RecordOutput::seek(void *opaque, int64_t offset, int whence)
+{
+    // the mp4 muxer seeks back to write the box sizes
+    RecordOutput *output = static_cast<RecordOutput *>(opaque);
+    if (whence & AVSEEK_SIZE) {
+        return output->m_file.size();
+    }
+    qint64 position;
+    switch (whence & ~AVSEEK_FORCE) {
+    case SEEK_SET:
+        position = offset;
+        break;
+    case SEEK_CUR:
+        position = output->m_file.pos() + offset;
+        break;
+    case SEEK_END:
+        position = output->m_file.size() + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (!output->m_file.seek(position)) {
+        return AVERROR(EIO);
+    }
+    return position;
+}
@@ -0,0 +1,58 @@
+#ifndef RECORDOUTPUT_H
+#define RECORDOUTPUT_H
+
+#include <atomic>
+
+#include <QFile>
+#include <QString>
+
+#include "../../../include/QtScrcpyCoreDef.h"
+
+extern "C"
+{
+#include "libavformat/avio.h"
+}
+
+// File of a recording behind a custom AVIOContext. The muxer writes into a
+// large buffer that reaches the file in few big writes instead of many small
+// ones, and the file is synced to the disk according to the policy.
+// Used by one thread at a time (the writer thread once started).
+class RecordOutput
+{
+public:
+    RecordOutput();
+    virtual ~RecordOutput();
+
+    // must be called before open()
+    void setBufferSize(int bytes);
+    void setSyncPolicy(qsc::RecordSyncPolicy policy);
+
+    bool open(const QString &fileName);
+    // flushes the buffer and syncs (unless RSP_NONE), false if some data
+    // could not be written or synced
+    bool close();
+    AVIOContext *avio();
+    // RSP_PERIODIC: flushes and syncs, called by the recorder every period
+    void syncPeriodic();
+
+    // thread safe
+    qsc::RecordStats stats();
+    void resetStats();
+
+private:
+    static int writePacket(void *opaque, uint8_t *buf, int size);
+    static int64_t seek(void *opaque, int64_t offset, int whence);
+    bool sync();
+
+private:
+    QFile m_file;
+    AVIOContext *m_avio = Q_NULLPTR;
+    int m_bufferSize = 1024 * 1024;
+    qsc::RecordSyncPolicy m_syncPolicy = qsc::RSP_CLOSE;
+
+    std::atomic<quint64> m_bytes;
+    std::atomic<quint64> m_writes;
+    std::atomic<quint64> m_syncs;
+};
+
+#endif // RECORDOUTPUT_H
@@ -0,0 +1,324 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThreadPool>
+
+#include "recorder.h"
+#include "replaybuffer.h"
+
+// the reservation starts small and doubles up to the budget
+#define REPLAY_MIN_CAPACITY (1024 * 1024)
+#define REPLAY_MAX_MEGABYTES 1024
+
+// memory budget shared by all the replay buffers
+static QMutex s_bytesMutex;
+static qint64 s_maxBytes = 0;
+static qint64 s_usedBytes = 0;
+
+static qint64 acquireBytes(qint64 wanted)
+{
+    QMutexLocker locker(&s_bytesMutex);
+    qint64 granted = wanted;
+    if (s_maxBytes > 0) {
+        granted = qBound<qint64>(0, s_maxBytes - s_usedBytes, wanted);
+    }
+    s_usedBytes += granted;
+    return granted;
+}
+
+static void releaseBytes(qint64 bytes)
+{
+    QMutexLocker locker(&s_bytesMutex);
+    s_usedBytes -= bytes;
+}
+
+static QThreadPool *replayPool()
+{
+    // muxing a clip is mostly file I/O, it never delays the other pools
+    static QThreadPool pool;
+    return &pool;
+}
+
+class ReplaySaveTask : public QRunnable
+{
+public:
+    ReplaySaveTask(const ReplayBuffer::Clip &clip, const QString &fileName, QObject *context, ReplayBuffer::Callback callback)
+        : m_clip(clip), m_fileName(fileName), m_context(context), m_callback(callback)
+    {}
+
+    void run() override
+    {
+        bool success = ReplayBuffer::save(m_clip, m_fileName);
+        // the clip can be big, free it before waiting for the GUI thread
+        m_clip = ReplayBuffer::Clip();
+
+        QPointer<QObject> context = m_context;
+        ReplayBuffer::Callback callback = m_callback;
+        QString filePath = success ? m_fileName : QString();
+        QMetaObject::invokeMethod(
+            QCoreApplication::instance(),
+            [context, callback, success, filePath]() {
+                if (context && callback) {
+                    callback(success, filePath);
+                }
+            },
+            Qt::QueuedConnection);
+    }
+
+private:
+    ReplayBuffer::Clip m_clip;
+    QString m_fileName;
+    QPointer<QObject> m_context;
+    ReplayBuffer::Callback m_callback;
+};
+
+ReplayBuffer::ReplayBuffer() {}
+
+ReplayBuffer::~ReplayBuffer()
+{
+    release();
+}
+
+void ReplayBuffer::setup(quint32 seconds, quint32 megabytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_duration = seconds * 1000000LL;
+    m_budget = qMin<qint64>(megabytes, REPLAY_MAX_MEGABYTES) * 1024 * 1024;
+    reset();
+    release();
+}
+
+void ReplayBuffer::setStreamInfo(const QSize &frameSize, AVCodecID codecId)
+{
+    QMutexLocker locker(&m_mutex);
+    m_frameSize = frameSize;
+    m_frameSizePending = false;
+    m_codecId = codecId;
+}
+
+void ReplayBuffer::push(const AVPacket *packet)
+{
+    if (!packet || packet->size <= 0) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    if (AV_NOPTS_VALUE == packet->pts) {
+        pushConfig(packet);
+    } else {
+        pushData(packet);
+    }
+}
+
+void ReplayBuffer::pushConfig(const AVPacket *packet)
+{
+    QByteArray config(reinterpret_cast<const char *>(packet->data), packet->size);
+    if (config == m_config) {
+        return;
+    }
+    // the size given at the start is stale after a rotation
+    m_frameSizePending = !m_config.isEmpty();
+    m_config = config;
+    // the packets before need the previous config (e.g. before a rotation)
+    reset();
+}
+
+void ReplayBuffer::pushData(const AVPacket *packet)
+{
+    bool keyFrame = packet->flags & AV_PKT_FLAG_KEY;
+    if (m_waitKeyFrame) {
+        if (!keyFrame) {
+            return;
+        }
+        m_waitKeyFrame = false;
+    }
+    if (keyFrame && m_frameSizePending) {
+        AVPacket config;
+        memset(&config, 0, sizeof(config));
+        config.data = reinterpret_cast<uint8_t *>(const_cast<char *>(m_config.constData()));
+        config.size = m_config.size();
+        QSize frameSize = Recorder::parseFrameSize(m_codecId, &config, packet);
+        if (frameSize.isValid()) {
+            m_frameSize = frameSize;
+        }
+        m_frameSizePending = false;
+    }
+
+    while (!fits(packet->size)) {
+        if (grow(packet->size)) {
+            continue;
+        }
+        if (m_packets.isEmpty()) {
+            // bigger than the budget
+            qWarning("replay buffer: packet of %d bytes dropped", packet->size);
+            m_waitKeyFrame = true;
+            return;
+        }
+        m_evicted += dropOldest();
+        if (m_packets.isEmpty() && !keyFrame) {
+            // a single group of pictures does not fit, wait for the next one
+            m_evicted++;
+            m_waitKeyFrame = true;
+            return;
+        }
+    }
+
+    Packet item;
+    item.pts = packet->pts;
+    item.flags = packet->flags;
+    item.data = QByteArray(reinterpret_cast<const char *>(packet->data), packet->size);
+    m_packets.enqueue(item);
+    m_bytes += packet->size;
+    if (keyFrame) {
+        m_keyFrames.enqueue(packet->pts);
+    }
+    trim();
+}
+
+bool ReplayBuffer::fits(int size)
+{
+    return m_bytes + size <= m_capacity;
+}
+
+bool ReplayBuffer::grow(int size)
+{
+    if (m_capacity >= m_budget) {
+        return false;
+    }
+    qint64 needed = m_bytes + size;
+    qint64 wanted = qMin(m_budget, qMax(qMax<qint64>(m_capacity * 2, REPLAY_MIN_CAPACITY), needed));
+    qint64 granted = acquireBytes(wanted - m_capacity);
+    if (m_capacity + granted < needed) {
+        // the global budget is exhausted
+        releaseBytes(granted);
+        return false;
+    }
+    m_capacity += granted;
+    return true;
+}
+
+int ReplayBuffer::dropOldest()
+{
+    // a group of pictures: the key frame and the packets up to the next one
+    int dropped = 0;
+    do {
+        m_bytes -= m_packets.dequeue().data.size();
+        dropped++;
+    } while (!m_packets.isEmpty() && !(m_packets.head().flags & AV_PKT_FLAG_KEY));
+    m_keyFrames.dequeue();
+    return dropped;
+}
+
+void ReplayBuffer::trim()
+{
+    // keep the last key frame that is at least m_duration old
+    qint64 limit = m_packets.last().pts - m_duration;
+    while (m_keyFrames.size() > 1 && m_keyFrames.at(1) <= limit) {
+        dropOldest();
+    }
+}
+
+void ReplayBuffer::reset()
+{
+    m_packets.clear();
+    m_keyFrames.clear();
+    m_bytes = 0;
+    m_waitKeyFrame = true;
+}
+
+void ReplayBuffer::release()
+{
+    releaseBytes(m_capacity);
+    m_capacity = 0;
+}
+
+bool ReplayBuffer::snapshot(Clip &clip)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_packets.isEmpty() || m_config.isEmpty()) {
+        return false;
+    }
+    clip.frameSize = m_frameSize;
+    clip.codecId = m_codecId;
+    clip.config = m_config;
+    // references only, the payloads are not copied
+    clip.packets = m_packets;
+    return true;
+}
+
+qsc::ReplayBufferStats ReplayBuffer::stats()
+{
+    QMutexLocker locker(&m_mutex);
+    qsc::ReplayBufferStats stats;
+    if (!m_packets.isEmpty()) {
+        stats.durationMs = (m_packets.last().pts - m_packets.head().pts) / 1000;
+    }
+    stats.packets = m_packets.size();
+    stats.bytes = m_bytes;
+    stats.capacity = m_capacity;
+    stats.evicted = m_evicted;
+    return stats;
+}
+
+void ReplayBuffer::setGlobalBudget(qint64 bytes)
+{
+    QMutexLocker locker(&s_bytesMutex);
+    // the rings already allocated are kept, the new budget limits their growth
+    s_maxBytes = qMax<qint64>(0, bytes);
+}
+
+bool ReplayBuffer::save(const Clip &clip, const QString &fileName)
+{
+    if (clip.packets.isEmpty() || clip.config.isEmpty()) {
+        return false;
+    }
+    if (Recorder::RECORDER_FORMAT_NULL == Recorder::formatFromName(QFileInfo(fileName).suffix())) {
+        qWarning() << "replay buffer: unsupported format" << fileName;
+        return false;
+    }
+    Recorder recorder(fileName);
+    recorder.setFrameSize(clip.frameSize);
+    recorder.setCodecId(clip.codecId);
+    if (!recorder.open()) {
+        return false;
+    }
+    AVPacket *packet = av_packet_alloc();
+    if (!packet) {
+        recorder.close();
+        return false;
+    }
+
+    // not ref counted, the packets point into the clip
+    packet->data = reinterpret_cast<uint8_t *>(const_cast<char *>(clip.config.constData()));
+    packet->size = clip.config.size();
+    packet->pts = AV_NOPTS_VALUE;
+    packet->dts = AV_NOPTS_VALUE;
+    bool ok = recorder.write(packet);
+
+    qint64 ptsOrigin = clip.packets.first().pts;
+    for (int i = 0; ok && i < clip.packets.size(); i++) {
+        const Packet &item = clip.packets.at(i);
+        packet->data = reinterpret_cast<uint8_t *>(const_cast<char *>(item.data.constData()));
+        packet->size = item.data.size();
+        packet->flags = item.flags;
+        packet->pts = item.pts - ptsOrigin;
+        packet->dts = packet->pts;
+        // like the recorder, an arbitrary duration for the last packet
+        packet->duration = i + 1 < clip.packets.size() ? clip.packets.at(i + 1).pts - item.pts : 100000;
+        ok = recorder.write(packet);
+    }
+    packet->data = Q_NULLPTR;
+    packet->size = 0;
+    av_packet_free(&packet);
+    recorder.close();
+    if (!ok || recorder.failed()) {
+        qCritical() << "Could not save replay buffer to" << fileName;
+        return false;
+    }
+    return true;
+}
+
+void ReplayBuffer::saveAsync(const Clip &clip, const QString &fileName, QObject *context, Callback callback)
+{
+    replayPool()->start(new ReplaySaveTask(clip, fileName, context, callback));
+}
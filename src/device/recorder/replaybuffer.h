@@ -0,0 +1,103 @@
+#ifndef REPLAYBUFFER_H
+#define REPLAYBUFFER_H
+
+#include <functional>
+
+#include <QByteArray>
+#include <QMutex>
+#include <QPointer>
+#include <QQueue>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+#include "../../../include/QtScrcpyCoreDef.h"
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+}
+
+// Keeps the last seconds of compressed packets in memory, starting on a key
+// frame, so that the preceding clip can be saved on demand without recording
+// all the time.
+// The payloads are copied into implicitly shared buffers of their exact size:
+// holding the demuxer packets would pin pool buffers sized for the biggest
+// packet, and the budget would not be honest. A snapshot only takes references.
+// The buffer reserves memory up to the device budget, and the devices share a
+// global budget. When it is full, the oldest group of pictures is dropped.
+class ReplayBuffer
+{
+public:
+    struct Packet
+    {
+        qint64 pts = 0;
+        int flags = 0;
+        QByteArray data;
+    };
+
+    // the packets of the buffer, shared with it
+    struct Clip
+    {
+        QSize frameSize;
+        AVCodecID codecId = AV_CODEC_ID_H264;
+        QByteArray config;
+        QVector<Packet> packets;
+    };
+
+    typedef std::function<void(bool success, const QString &filePath)> Callback;
+
+    ReplayBuffer();
+    virtual ~ReplayBuffer();
+
+    // seconds: duration kept (at least, from the key frame before)
+    // megabytes: memory budget of this device
+    void setup(quint32 seconds, quint32 megabytes);
+    void setStreamInfo(const QSize &frameSize, AVCodecID codecId);
+    // stream thread, config and data packets
+    void push(const AVPacket *packet);
+    // false if no key frame was received yet
+    bool snapshot(Clip &clip);
+    qsc::ReplayBufferStats stats();
+
+    // memory budget shared by all the devices, 0: no limit
+    static void setGlobalBudget(qint64 bytes);
+    // muxes the clip to fileName (mp4/mkv), blocking
+    static bool save(const Clip &clip, const QString &fileName);
+    // saves on a worker, the callback runs on the GUI thread, and not at all
+    // if context was deleted meanwhile
+    static void saveAsync(const Clip &clip, const QString &fileName, QObject *context, Callback callback);
+
+private:
+    void pushConfig(const AVPacket *packet);
+    void pushData(const AVPacket *packet);
+    // false if size more bytes do not fit in the reserved memory
+    bool fits(int size);
+    bool grow(int size);
+    // drops the oldest group of pictures, returns the number of packets
+    int dropOldest();
+    void trim();
+    void reset();
+    void release();
+
+private:
+    QMutex m_mutex;
+    qint64 m_duration = 0; // us
+    qint64 m_budget = 0;   // bytes
+    QSize m_frameSize;
+    // the config changed, the frame size is read from the next key frame
+    bool m_frameSizePending = false;
+    AVCodecID m_codecId = AV_CODEC_ID_H264;
+    QByteArray m_config;
+    // reserved from the global budget
+    qint64 m_capacity = 0;
+    qint64 m_bytes = 0;
+    QQueue<Packet> m_packets;
+    // pts of the key frames in the queue, the first one is its head
+    QQueue<qint64> m_keyFrames;
+    // the buffer was dropped entirely, it restarts on a key frame
+    bool m_waitKeyFrame = true;
+    quint64 m_evicted = 0;
+};
+
+#endif // REPLAYBUFFER_H
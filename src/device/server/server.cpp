@@ -182,6 +182,10 @@ bool Server::execute()
     if (!m_params.codecName.isEmpty()) {
         args << QString("encoder_name=%1").arg(m_params.codecName);
     }
+    // 服务端默认h264，可不传
+    if (!m_params.videoCodec.isEmpty() && "h264" != m_params.videoCodec) {
+        args << QString("video_codec=%1").arg(m_params.videoCodec);
+    }
     args << "audio=false";
     // 服务端默认-1，可不传
     if (-1 != m_params.scid) {
@@ -337,7 +341,6 @@ bool Server::readInfo(VideoSocket *videoSocket, QString &deviceName, QSize &size
 {
     QElapsedTimer timer;
     timer.start();
-    unsigned char buf[DEVICE_NAME_FIELD_LENGTH + 12];
     while (videoSocket->bytesAvailable() <= (DEVICE_NAME_FIELD_LENGTH + 12)) {
         videoSocket->waitForReadyRead(300);
         if (timer.elapsed() > 3000) {
@@ -347,21 +350,40 @@ bool Server::readInfo(VideoSocket *videoSocket, QString &deviceName, QSize &size
     }
     qDebug() << "readInfo wait time:" << timer.elapsed();
 
-    qint64 len = videoSocket->read((char *)buf, sizeof(buf));
-    if (len < DEVICE_NAME_FIELD_LENGTH + 12) {
+    // keep the raw header, the stream capture needs it to replay the session
+    m_deviceInfo = videoSocket->read(DEVICE_NAME_FIELD_LENGTH + 12);
+    return parseDeviceInfo(m_deviceInfo, deviceName, size, m_codecId);
+}
+
+bool Server::parseDeviceInfo(const QByteArray &deviceInfo, QString &deviceName, QSize &size, quint32 &codecId)
+{
+    if (deviceInfo.size() < DEVICE_NAME_FIELD_LENGTH + 12) {
         qInfo("Could not retrieve device information");
         return false;
     }
+    unsigned char buf[DEVICE_NAME_FIELD_LENGTH + 12];
+    memcpy(buf, deviceInfo.constData(), sizeof(buf));
     buf[DEVICE_NAME_FIELD_LENGTH - 1] = '\0'; // in case the client sends garbage
     deviceName = QString::fromUtf8((const char *)buf);
 
-    // 前4个字节是AVCodecID,当前只支持H264,所以先不解析
+    // 前4个字节是编码格式 "h264" "h265" "\0av1"(0x00617631)
+    codecId = bufferRead32be(&buf[DEVICE_NAME_FIELD_LENGTH]);
     size.setWidth(bufferRead32be(&buf[DEVICE_NAME_FIELD_LENGTH + 4]));
     size.setHeight(bufferRead32be(&buf[DEVICE_NAME_FIELD_LENGTH + 8]));
 
     return true;
 }
 
+QByteArray Server::getDeviceInfo()
+{
+    return m_deviceInfo;
+}
+
+quint32 Server::getCodecId()
+{
+    return m_codecId;
+}
+
 void Server::startAcceptTimeoutTimer()
 {
     stopAcceptTimeoutTimer();
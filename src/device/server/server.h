@@ -46,9 +46,10 @@ public:
         // 例如 CodecOptions="profile=1,level=2"
         // 更多编码选项参考 https://d.android.com/reference/android/media/MediaFormat
         QString codecOptions = "";
-        // 指定编码器名称(必须是H.264编码器)，""表示默认
+        // 指定编码器名称(必须与videoCodec一致)，""表示默认
         // 例如 CodecName="OMX.qcom.video.encoder.avc"
         QString codecName = "";
+        QString videoCodec = "h264";   // 视频编码格式 h264/h265/av1
 
         QString crop = "";             // 视频裁剪
         bool control = true;           // 安卓端是否接收键鼠控制
@@ -64,6 +65,12 @@ public:
     Server::ServerParams getParams();
     VideoSocket *removeVideoSocket();
     QTcpSocket *getControlSocket();
+    // raw device info header sent by the server, valid after serverStarted
+    QByteArray getDeviceInfo();
+    // video codec from the device info header, see SC_CODEC_ID_*
+    quint32 getCodecId();
+
+    static bool parseDeviceInfo(const QByteArray &deviceInfo, QString &deviceName, QSize &size, quint32 &codecId);
 
 signals:
     void serverStarted(bool success, const QString &deviceName = "", const QSize &size = QSize());
@@ -105,6 +112,8 @@ private:
     quint32 m_restartCount = 0;
     QString m_deviceName = "";
     QSize m_deviceSize = QSize();
+    QByteArray m_deviceInfo;
+    quint32 m_codecId = 0;
     ServerParams m_params;
 
     SERVER_START_STEP m_serverStartStep = SSS_NULL;
@@ -2,6 +2,14 @@
 #include <QDebug>
 #include <QThread>
 
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+
 #include "videosocket.h"
 
 VideoSocket::VideoSocket(QObject *parent) : QTcpSocket(parent)
@@ -20,12 +28,76 @@ qint32 VideoSocket::subThreadRecvData(quint8 *buf, qint32 bufSize)
     // this function cant call in main thread
     Q_ASSERT(QCoreApplication::instance()->thread() != QThread::currentThread());
 
-    while (bytesAvailable() < bufSize) {
-        if (!waitForReadyRead(-1)) {
+    qint32 recvLen = 0;
+
+    // bytes already buffered by qt (for example received together with the device info)
+    // must be consumed first
+    qint64 buffered = bytesAvailable();
+    if (buffered > 0) {
+        qint64 len = read((char *)buf, qMin<qint64>(buffered, bufSize));
+        if (len < 0) {
             return 0;
         }
+        recvLen += static_cast<qint32>(len);
+    }
+
+    // the demuxer thread has no event loop, so qt never reads this socket behind our back:
+    // read the rest from the native socket directly into buf, avoiding the copy through
+    // the QTcpSocket read buffer
+    while (recvLen < bufSize) {
+        qint32 len = nativeRecv(buf + recvLen, bufSize - recvLen);
+        if (len <= 0) {
+            // end of stream or error
+            return recvLen;
+        }
+        recvLen += len;
+    }
+
+    return recvLen;
+}
+
+qint32 VideoSocket::nativeRecv(quint8 *buf, qint32 bufSize)
+{
+    qintptr fd = socketDescriptor();
+    if (-1 == fd) {
+        return -1;
     }
 
-    // recv data
-    return read((char *)buf, bufSize);
+    for (;;) {
+#ifdef Q_OS_WIN
+        int len = ::recv(static_cast<SOCKET>(fd), (char *)buf, bufSize, 0);
+        if (SOCKET_ERROR != len) {
+            return len;
+        }
+        if (WSAEWOULDBLOCK != WSAGetLastError()) {
+            return -1;
+        }
+        WSAPOLLFD pfd;
+        pfd.fd = static_cast<SOCKET>(fd);
+        pfd.events = POLLRDNORM;
+        pfd.revents = 0;
+        if (SOCKET_ERROR == WSAPoll(&pfd, 1, -1)) {
+            return -1;
+        }
+#else
+        ssize_t len = ::recv(static_cast<int>(fd), buf, static_cast<size_t>(bufSize), 0);
+        if (len >= 0) {
+            return static_cast<qint32>(len);
+        }
+        if (EINTR == errno) {
+            continue;
+        }
+        if (EAGAIN != errno && EWOULDBLOCK != errno) {
+            return -1;
+        }
+        // qt sockets are non blocking, wait for data
+        struct pollfd pfd;
+        pfd.fd = static_cast<int>(fd);
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, -1) < 0 && EINTR != errno) {
+            return -1;
+        }
+#endif
+    }
 }
@@ -11,6 +11,9 @@ public:
     virtual ~VideoSocket();
 
     qint32 subThreadRecvData(quint8 *buf, qint32 bufSize);
+
+private:
+    qint32 nativeRecv(quint8 *buf, qint32 bufSize);
 };
 
 #endif // VIDEOSOCKET_H
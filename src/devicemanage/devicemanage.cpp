@@ -4,8 +4,12 @@
 #include <QWheelEvent>
 
 #include "devicemanage.h"
+#include "decoder.h"
+#include "decodescheduler.h"
 #include "device.h"
 #include "demuxer.h"
+#include "recorder.h"
+#include "replaybuffer.h"
 
 namespace qsc {
 
@@ -17,10 +21,18 @@ IDeviceManage& IDeviceManage::getInstance() {
 }
 
 DeviceManage::DeviceManage() {
+    // FrameRef and the analysis results can be queued to other threads
+    qRegisterMetaType<FrameRef>("qsc::FrameRef");
+    qRegisterMetaType<DirtyRegion>("qsc::DirtyRegion");
+    qRegisterMetaType<MotionInfo>("qsc::MotionInfo");
     Demuxer::init();
 }
 
 DeviceManage::~DeviceManage() {
+    if (m_decodeScheduler) {
+        delete m_decodeScheduler;
+        m_decodeScheduler = Q_NULLPTR;
+    }
     Demuxer::deInit();
 }
 
@@ -58,7 +70,8 @@ bool DeviceManage::connectDevice(qsc::DeviceParams params)
         }
     }
     */
-    IDevice *device = new Device(params);
+    Device *device = new Device(params);
+    device->setDecodeScheduler(m_decodeScheduler);
     connect(device, &Device::deviceConnected, this, &DeviceManage::onDeviceConnected);
     connect(device, &Device::deviceDisconnected, this, &DeviceManage::onDeviceDisconnected);
     if (!device->connectDevice()) {
@@ -93,6 +106,38 @@ void DeviceManage::disconnectAllDevice()
     }
 }
 
+void DeviceManage::setMaxDecodeThreads(int maxThreads)
+{
+    Decoder::setMaxThreads(maxThreads);
+}
+
+void DeviceManage::setReplayBufferBudget(int megabytes)
+{
+    ReplayBuffer::setGlobalBudget(qMax(0, megabytes) * 1024LL * 1024LL);
+}
+
+void DeviceManage::setRecordWriters(int writers)
+{
+    if (!Recorder::setWriterThreads(writers)) {
+        qWarning("record writers must be set before the first recording");
+    }
+}
+
+void DeviceManage::setSharedDecodeWorkers(int workers)
+{
+    if (!m_devices.isEmpty()) {
+        qWarning("shared decode workers must be set before connecting devices");
+        return;
+    }
+    if (m_decodeScheduler) {
+        delete m_decodeScheduler;
+        m_decodeScheduler = Q_NULLPTR;
+    }
+    if (workers > 0) {
+        m_decodeScheduler = new DecodeScheduler(workers);
+    }
+}
+
 void DeviceManage::onDeviceConnected(bool success, const QString &serial, const QString &deviceName, const QSize &size)
 {
     emit deviceConnected(success, serial, deviceName, size);
@@ -5,6 +5,8 @@
 
 #include "../../include/QtScrcpyCore.h"
 
+class DecodeScheduler;
+
 namespace qsc {
 
 class DeviceManage : public IDeviceManage
@@ -19,6 +21,10 @@ public:
     bool connectDevice(qsc::DeviceParams params) override;
     bool disconnectDevice(const QString &serial) override;
     void disconnectAllDevice() override;
+    void setMaxDecodeThreads(int maxThreads) override;
+    void setSharedDecodeWorkers(int workers) override;
+    void setReplayBufferBudget(int megabytes) override;
+    void setRecordWriters(int writers) override;
 
 protected slots:
     void onDeviceConnected(bool success, const QString& serial, const QString& deviceName, const QSize& size);
@@ -32,6 +38,7 @@ private:
     QMap<QString, QPointer<IDevice>> m_devices;
     quint16 m_localPortStart = 27183;
     QString m_script;
+    DecodeScheduler *m_decodeScheduler = Q_NULLPTR;
 };
 
 }
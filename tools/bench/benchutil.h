@@ -0,0 +1,89 @@
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QVector>
+#include <ctime>
+
+extern "C"
+{
+#include "libavcodec/avcodec.h"
+}
+
+// Helpers shared by the benchmarks.
+
+// splits a raw annex-b h264 file into access units, like the scrcpy server
+// sends them: the config (SPS/PPS) comes along with the first key frame
+// pts: i * 1000000 / fps
+inline bool loadAnnexB(const QString &fileName, int fps, QVector<AVPacket *> &packets)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray data = file.readAll();
+    data.append(QByteArray(AV_INPUT_BUFFER_PADDING_SIZE, '\0'));
+
+    AVCodecParserContext *parser = av_parser_init(AV_CODEC_ID_H264);
+    AVCodecContext *codecCtx = avcodec_alloc_context3(Q_NULLPTR);
+    if (!parser || !codecCtx) {
+        return false;
+    }
+    const uint8_t *buf = reinterpret_cast<const uint8_t *>(data.constData());
+    int size = data.size() - AV_INPUT_BUFFER_PADDING_SIZE;
+    // a null size flushes the last access unit
+    for (bool flush = false; !flush;) {
+        flush = !size;
+        uint8_t *out = Q_NULLPTR;
+        int outSize = 0;
+        int len = av_parser_parse2(parser, codecCtx, &out, &outSize, buf, size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, -1);
+        buf += len;
+        size -= len;
+        if (!outSize) {
+            continue;
+        }
+        AVPacket *packet = av_packet_alloc();
+        if (!packet || av_new_packet(packet, outSize)) {
+            av_packet_free(&packet);
+            break;
+        }
+        memcpy(packet->data, out, outSize);
+        packet->pts = packets.size() * 1000000LL / fps;
+        packet->dts = packet->pts;
+        if (parser->key_frame > 0) {
+            packet->flags |= AV_PKT_FLAG_KEY;
+        }
+        packets.append(packet);
+    }
+    av_parser_close(parser);
+    avcodec_free_context(&codecCtx);
+    return !packets.isEmpty();
+}
+
+inline void freePackets(QVector<AVPacket *> &packets)
+{
+    for (AVPacket *packet : packets) {
+        av_packet_free(&packet);
+    }
+    packets.clear();
+}
+
+// cpu time of the process (all its threads) and wall time of a run
+class BenchTimer
+{
+public:
+    void start()
+    {
+        m_cpuStart = std::clock();
+        m_wall.start();
+    }
+    double cpuMs() const { return (std::clock() - m_cpuStart) * 1000.0 / CLOCKS_PER_SEC; }
+    double wallMs() const { return m_wall.nsecsElapsed() / 1e6; }
+
+private:
+    std::clock_t m_cpuStart = 0;
+    QElapsedTimer m_wall;
+};
+
+#endif // BENCHUTIL_H
@@ -0,0 +1,87 @@
+#include <QElapsedTimer>
+#include <cstdio>
+#include <cstdlib>
+
+#include "benchutil.h"
+#include "nalscanner.h"
+
+// Key frame detection of the demuxer: NalScanner against the h264 parser
+// context it replaced (av_parser_parse2 on complete frames), on one thread.
+//   qtscrcpy-bench-nalscanner <file.h264> [iterations]
+// file.h264: raw annex-b h264, see thumbnailbench.cpp
+// default 100 passes over the access units of the file.
+
+static void report(const char *name, qint64 nsecs, int packets, qint64 bytes, int keyFrames)
+{
+    printf("%-14s %9.3f us/packet %9.1f MB/s %6d key frames\n", name, nsecs / 1e3 / packets, bytes * 1e3 / nsecs, keyFrames);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.h264> [iterations]\n", argv[0]);
+        return 1;
+    }
+    int iterations = argc > 2 ? atoi(argv[2]) : 100;
+    if (iterations <= 0) {
+        fprintf(stderr, "usage: %s <file.h264> [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    QVector<AVPacket *> packets;
+    if (!loadAnnexB(argv[1], 60, packets)) {
+        fprintf(stderr, "Could not read h264 access units from %s\n", argv[1]);
+        return 1;
+    }
+    qint64 bytes = 0;
+    for (const AVPacket *packet : packets) {
+        bytes += packet->size;
+    }
+    int count = packets.size() * iterations;
+    bytes *= iterations;
+    printf("%d access units (%.1f KB on average), %d iterations\n", packets.size(), bytes / 1024.0 / count, iterations);
+
+    static const char *const scanNames[] = { "scanner", "scanner full" };
+    for (int full = 0; full < 2; full++) {
+        int keyFrames = 0;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; i++) {
+            for (const AVPacket *packet : packets) {
+                if (NalScanner::scanH264(packet->data, packet->size, full).keyFrame) {
+                    keyFrames++;
+                }
+            }
+        }
+        report(scanNames[full], timer.nsecsElapsed(), count, bytes, keyFrames);
+    }
+
+    // as the demuxer did before the scanner
+    const AVCodec *codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+    AVCodecContext *codecCtx = avcodec_alloc_context3(codec);
+    AVCodecParserContext *parser = av_parser_init(AV_CODEC_ID_H264);
+    if (!codecCtx || !parser) {
+        fprintf(stderr, "Could not initialize the parser\n");
+        return 1;
+    }
+    parser->flags |= PARSER_FLAG_COMPLETE_FRAMES;
+    int keyFrames = 0;
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < iterations; i++) {
+        for (const AVPacket *packet : packets) {
+            uint8_t *outData = Q_NULLPTR;
+            int outLen = 0;
+            av_parser_parse2(parser, codecCtx, &outData, &outLen, packet->data, packet->size, AV_NOPTS_VALUE, AV_NOPTS_VALUE, -1);
+            if (1 == parser->key_frame) {
+                keyFrames++;
+            }
+        }
+    }
+    report("av_parser", timer.nsecsElapsed(), count, bytes, keyFrames);
+    av_parser_close(parser);
+    avcodec_free_context(&codecCtx);
+
+    freePackets(packets);
+    return 0;
+}
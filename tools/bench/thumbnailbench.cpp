@@ -0,0 +1,103 @@
+#include <cstdio>
+#include <cstdlib>
+
+#include "benchutil.h"
+#include "decoder.h"
+
+// CPU cost of one stream in the decoding modes of a wall of devices, on one
+// decoding thread each: the full decoding against the thumbnail settings.
+//   qtscrcpy-bench-thumbnail <file.h264> [fps] [repeat]
+// file.h264: raw annex-b h264 (e.g. recorded with scrcpy --record file.h264 or
+// extracted with ffmpeg -i file.mp4 -c copy -bsf h264_mp4toannexb file.h264)
+// default 60 fps, the file is decoded 3 times.
+// Only the decoding thread is measured: the conversions of the delivered frames
+// for the observers come on top of "full" and "thumbnail state".
+
+struct Mode
+{
+    const char *name;
+    std::function<void(Decoder &decoder)> setup;
+};
+
+static void run(const Mode &mode, const QVector<AVPacket *> &packets, int fps, int repeat)
+{
+    int frames = 0;
+    int thumbnails = 0;
+    Decoder decoder([](const AVFrame *) {});
+    decoder.setThreading(1, false);
+    decoder.setFrameTap([&frames](const AVFrame *) { frames++; });
+    QObject::connect(&decoder, &Decoder::newThumbnail, [&thumbnails](qsc::FrameRef) { thumbnails++; });
+    mode.setup(decoder);
+    if (!decoder.open()) {
+        fprintf(stderr, "%s: could not open the decoder\n", mode.name);
+        return;
+    }
+
+    AVPacket *packet = av_packet_alloc();
+    qint64 duration = packets.size() * 1000000LL / fps;
+    BenchTimer timer;
+    timer.start();
+    for (int r = 0; r < repeat; r++) {
+        for (const AVPacket *source : packets) {
+            av_packet_ref(packet, source);
+            packet->pts += r * duration;
+            packet->dts = packet->pts;
+            decoder.push(packet);
+            av_packet_unref(packet);
+        }
+    }
+    double cpuMs = timer.cpuMs();
+    double wallMs = timer.wallMs();
+    decoder.close();
+    av_packet_free(&packet);
+
+    // share of a core taken by a stream in real time
+    double load = 100.0 * cpuMs / (repeat * duration / 1000.0);
+    printf("%-16s %8.1f %8.1f %7.1f%% %9.1f %7d %7d\n", mode.name, cpuMs, wallMs, load, load > 0 ? 100.0 / load : 0.0, frames,
+           thumbnails);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <file.h264> [fps] [repeat]\n", argv[0]);
+        return 1;
+    }
+    int fps = argc > 2 ? atoi(argv[2]) : 60;
+    int repeat = argc > 3 ? atoi(argv[3]) : 3;
+    if (fps <= 0 || repeat <= 0) {
+        fprintf(stderr, "usage: %s <file.h264> [fps] [repeat]\n", argv[0]);
+        return 1;
+    }
+
+    QVector<AVPacket *> packets;
+    if (!loadAnnexB(argv[1], fps, packets)) {
+        fprintf(stderr, "Could not read h264 access units from %s\n", argv[1]);
+        return 1;
+    }
+    printf("%d access units at %d fps, %d times\n", packets.size(), fps, repeat);
+
+    // the thumbnail settings of the device wall: 240px wide at 5 fps
+    static const Mode modes[] = {
+        { "full", [](Decoder &) {} },
+        { "thumbnail state", [](Decoder &decoder) { decoder.setConsumptionState(qsc::CS_THUMBNAIL, 5); } },
+        { "thumbnail",
+          [](Decoder &decoder) {
+              decoder.setThumbnail(240, AV_PIX_FMT_RGB32, 5);
+              decoder.setThumbnailProfile(false);
+          } },
+        { "thumbnail key",
+          [](Decoder &decoder) {
+              decoder.setThumbnail(240, AV_PIX_FMT_RGB32, 5);
+              decoder.setThumbnailProfile(true);
+          } },
+        { "hidden", [](Decoder &decoder) { decoder.setConsumptionState(qsc::CS_HIDDEN, 0); } },
+    };
+    printf("%-16s %8s %8s %8s %9s %7s %7s\n", "mode", "cpu ms", "wall ms", "core", "streams", "frames", "thumbs");
+    for (const Mode &mode : modes) {
+        run(mode, packets, fps, repeat);
+    }
+
+    freePackets(packets);
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include <QElapsedTimer>
+#include <cstdio>
+#include <cstdlib>
+
+#include "scalercache.h"
+#include "yuvtorgb.h"
+
+extern "C"
+{
+#include "libavutil/imgutils.h"
+}
+
+// Same size YUV420P -> RGB32: the YuvToRgb kernels against swscale, on one thread.
+//   qtscrcpy-bench-yuvtorgb [width] [height] [iterations]
+// default 1080x2340 (a common phone screen), 300 iterations.
+// "selected" is what ScalerCache::scale() uses for this size.
+
+static AVFrame *makeFrame(int width, int height)
+{
+    AVFrame *frame = av_frame_alloc();
+    frame->width = width;
+    frame->height = height;
+    frame->format = AV_PIX_FMT_YUV420P;
+    if (av_frame_get_buffer(frame, 32) < 0) {
+        av_frame_free(&frame);
+        return Q_NULLPTR;
+    }
+    // gradients, so that nothing is constant
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            frame->data[0][y * frame->linesize[0] + x] = static_cast<uint8_t>(x + y);
+        }
+    }
+    for (int y = 0; y < height / 2; y++) {
+        for (int x = 0; x < width / 2; x++) {
+            frame->data[1][y * frame->linesize[1] + x] = static_cast<uint8_t>(x * 3);
+            frame->data[2][y * frame->linesize[2] + x] = static_cast<uint8_t>(y * 5);
+        }
+    }
+    return frame;
+}
+
+static void report(const char *name, qint64 nsecs, int iterations)
+{
+    printf("%-10s %8.3f ms/frame\n", name, nsecs / 1e6 / iterations);
+}
+
+int main(int argc, char *argv[])
+{
+    int width = argc > 1 ? atoi(argv[1]) : 1080;
+    int height = argc > 2 ? atoi(argv[2]) : 2340;
+    int iterations = argc > 3 ? atoi(argv[3]) : 300;
+    if (width <= 0 || height <= 0 || iterations <= 0) {
+        fprintf(stderr, "usage: %s [width] [height] [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    AVFrame *frame = makeFrame(width, height);
+    AVFrame *output = av_frame_alloc();
+    output->width = width;
+    output->height = height;
+    output->format = AV_PIX_FMT_RGB32;
+    if (!frame || av_frame_get_buffer(output, 32) < 0) {
+        fprintf(stderr, "OOM\n");
+        return 1;
+    }
+    printf("%dx%d YUV420P -> RGB32, %d iterations\n", width, height, iterations);
+
+    static const YuvToRgb::Kernel kernels[] = { YuvToRgb::KERNEL_SCALAR, YuvToRgb::KERNEL_SSE2, YuvToRgb::KERNEL_AVX2, YuvToRgb::KERNEL_NEON };
+    for (YuvToRgb::Kernel kernel : kernels) {
+        if (!YuvToRgb::isKernelSupported(kernel)) {
+            continue;
+        }
+        YuvToRgb::convert(frame, output->data[0], output->linesize[0], YuvToRgb::COLOR_SPACE_BT601, false, 1, kernel);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; i++) {
+            YuvToRgb::convert(frame, output->data[0], output->linesize[0], YuvToRgb::COLOR_SPACE_BT601, false, 1, kernel);
+        }
+        report(YuvToRgb::kernelName(kernel), timer.nsecsElapsed(), iterations);
+    }
+
+    struct SwsContext *ctx = sws_getContext(width, height, AV_PIX_FMT_YUV420P, width, height, AV_PIX_FMT_RGB32, SWS_BILINEAR, Q_NULLPTR, Q_NULLPTR, Q_NULLPTR);
+    if (ctx) {
+        sws_scale(ctx, frame->data, frame->linesize, 0, height, output->data, output->linesize);
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < iterations; i++) {
+            sws_scale(ctx, frame->data, frame->linesize, 0, height, output->data, output->linesize);
+        }
+        report("swscale", timer.nsecsElapsed(), iterations);
+        sws_freeContext(ctx);
+    }
+
+    printf("selected: %s\n", YuvToRgb::isPreferred(frame) ? YuvToRgb::kernelName(YuvToRgb::KERNEL_AUTO) : "swscale");
+
+    av_frame_free(&output);
+    av_frame_free(&frame);
+    return 0;
+}
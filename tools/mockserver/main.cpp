@@ -0,0 +1,139 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QSettings>
+#include <QStringList>
+#include <cstdio>
+
+#include "mockserver.h"
+
+// A fake adb for device free end to end tests and benchmarks.
+//
+// Point AdbProcess at it (QTSCRCPY_ADB_PATH or AdbProcess::setAdbPath()), it answers
+// push/reverse/forward/shell like a connected device, and "shell ... app_process ..."
+// runs the mock scrcpy server, configured by environment variables:
+//   QSC_MOCK_VIDEO        capture file (DeviceParams::captureFile) or raw annex-b h264 file, required
+//   QSC_MOCK_DEVICE_NAME  device name for raw h264 files, default "mock"
+//   QSC_MOCK_SIZE         frame size for raw h264 files, default "720x1280"
+//   QSC_MOCK_FPS          frame rate for raw h264 files, default 60
+//   QSC_MOCK_LOOP         "0" stops at the end of the file, default loops forever
+//
+// Each adb call is a new process, the reverse/forward tunnels are kept in a temp ini file.
+
+static QString stateFile()
+{
+    return QDir::temp().absoluteFilePath("qtscrcpy-mock-adb.ini");
+}
+
+static QString envValue(const char *name, const QString &defaultValue)
+{
+    QByteArray value = qgetenv(name);
+    return value.isEmpty() ? defaultValue : QString::fromLocal8Bit(value);
+}
+
+static int tunnel(QSettings &state, const QString &serial, const QStringList &args)
+{
+    // reverse localabstract:<name> tcp:<port>
+    // reverse --remove localabstract:<name>
+    // forward tcp:<port> localabstract:<name>
+    // forward --remove tcp:<port>
+    const QString &type = args[0];
+    state.beginGroup(serial + "-" + type);
+    if (args.size() >= 3 && "--remove" == args[1]) {
+        for (const QString &key : state.childKeys()) {
+            if ("reverse" == type ? "localabstract:" + key == args[2] : "tcp:" + state.value(key).toString() == args[2]) {
+                state.remove(key);
+            }
+        }
+    } else if (args.size() >= 3) {
+        QString local = "reverse" == type ? args[2] : args[1];
+        QString remote = "reverse" == type ? args[1] : args[2];
+        state.setValue(remote.section(':', 1), local.section(':', 1).toUInt());
+    } else {
+        qCritical("mock adb: bad %s args", type.toUtf8().data());
+        return 1;
+    }
+    state.endGroup();
+    return 0;
+}
+
+static int runServer(QCoreApplication &app, QSettings &state, const QString &serial, const QStringList &args)
+{
+    // shell CLASSPATH=... app_process / com.genymobile.scrcpy.Server <version> key=value...
+    MockServer::Params params;
+    QString socketName = "scrcpy";
+    for (const QString &arg : args) {
+        if (arg.startsWith("scid=")) {
+            socketName = "scrcpy_" + arg.section('=', 1);
+        } else if ("tunnel_forward=true" == arg) {
+            params.tunnelForward = true;
+        }
+    }
+
+    state.beginGroup(serial + (params.tunnelForward ? "-forward" : "-reverse"));
+    if (!state.contains(socketName) && !state.childKeys().isEmpty()) {
+        // "scid=-1" is not sent, use any registered tunnel
+        socketName = state.childKeys().last();
+    }
+    if (!state.contains(socketName)) {
+        qCritical("mock adb: no tunnel for %s", socketName.toUtf8().data());
+        return 1;
+    }
+    params.port = static_cast<quint16>(state.value(socketName).toUInt());
+    state.endGroup();
+
+    params.videoFile = envValue("QSC_MOCK_VIDEO", "");
+    params.deviceName = envValue("QSC_MOCK_DEVICE_NAME", params.deviceName);
+    QStringList size = envValue("QSC_MOCK_SIZE", "720x1280").split('x');
+    if (2 == size.size()) {
+        params.size = QSize(size[0].toInt(), size[1].toInt());
+    }
+    params.fps = envValue("QSC_MOCK_FPS", "60").toUInt();
+    params.loop = "0" != envValue("QSC_MOCK_LOOP", "1");
+    if (params.videoFile.isEmpty()) {
+        qCritical("mock adb: QSC_MOCK_VIDEO is not set");
+        return 1;
+    }
+
+    MockServer server(params);
+    QObject::connect(&server, &MockServer::finished, &app, &QCoreApplication::exit);
+    if (!server.start()) {
+        return 1;
+    }
+    return app.exec();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments().mid(1);
+
+    QString serial = "mock-0";
+    if (args.size() >= 2 && "-s" == args[0]) {
+        serial = args[1];
+        args = args.mid(2);
+    }
+    if (args.isEmpty()) {
+        qCritical("mock adb: no command");
+        return 1;
+    }
+
+    QSettings state(stateFile(), QSettings::IniFormat);
+    const QString &command = args[0];
+    if ("devices" == command) {
+        printf("List of devices attached\n%s\tdevice\n\n", serial.toUtf8().data());
+        return 0;
+    }
+    if ("push" == command) {
+        printf("%s: 1 file pushed (mock)\n", args.value(1).toUtf8().data());
+        return 0;
+    }
+    if ("reverse" == command || "forward" == command) {
+        return tunnel(state, serial, args);
+    }
+    if ("shell" == command && args.contains("app_process")) {
+        return runServer(app, state, serial, args);
+    }
+    // shell rm, settings, ip, install, connect...: nothing to do
+    return 0;
+}
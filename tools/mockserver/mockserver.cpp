@@ -0,0 +1,249 @@
+#include <QDebug>
+#include <QHostAddress>
+
+#include "mockserver.h"
+
+// keep in sync with src/device/controller/inputconvert/controlmsg.h
+enum ControlMsgType
+{
+    CMT_INJECT_KEYCODE = 0,
+    CMT_INJECT_TEXT,
+    CMT_INJECT_TOUCH,
+    CMT_INJECT_SCROLL,
+    CMT_BACK_OR_SCREEN_ON,
+    CMT_EXPAND_NOTIFICATION_PANEL,
+    CMT_EXPAND_SETTINGS_PANEL,
+    CMT_COLLAPSE_PANELS,
+    CMT_GET_CLIPBOARD,
+    CMT_SET_CLIPBOARD,
+    CMT_SET_DISPLAY_POWER,
+    CMT_ROTATE_DEVICE,
+    CMT_RESET_VIDEO = 17
+};
+
+// keep in sync with src/device/controller/receiver/devicemsg.h
+#define DMT_GET_CLIPBOARD 0
+
+static quint32 bufferRead32be(const QByteArray &buf, int offset)
+{
+    const uchar *data = reinterpret_cast<const uchar *>(buf.constData()) + offset;
+    return static_cast<quint32>((data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]);
+}
+
+static void bufferWrite32be(char *buf, quint32 value)
+{
+    buf[0] = static_cast<char>(value >> 24);
+    buf[1] = static_cast<char>((value >> 16) & 0xff);
+    buf[2] = static_cast<char>((value >> 8) & 0xff);
+    buf[3] = static_cast<char>(value & 0xff);
+}
+
+MockServer::MockServer(const Params &params, QObject *parent)
+    : QObject(parent), m_params(params), m_videoSource(params.videoFile, params.deviceName, params.size, params.fps, params.loop)
+{
+    m_sendTimer.setSingleShot(true);
+    m_sendTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_sendTimer, &QTimer::timeout, this, &MockServer::sendPackets);
+    connect(&m_tcpServer, &QTcpServer::newConnection, this, &MockServer::onNewConnection);
+}
+
+MockServer::~MockServer() {}
+
+bool MockServer::start()
+{
+    if (!m_videoSource.open()) {
+        return false;
+    }
+
+    if (m_params.tunnelForward) {
+        // the client connects to us through "adb forward"
+        if (!m_tcpServer.listen(QHostAddress::LocalHost, m_params.port)) {
+            qCritical("mock: could not listen on port %d", m_params.port);
+            return false;
+        }
+        return true;
+    }
+
+    // "adb reverse": we connect to the client, video socket first
+    m_videoSocket = new QTcpSocket(this);
+    m_videoSocket->connectToHost(QHostAddress::LocalHost, m_params.port);
+    if (!m_videoSocket->waitForConnected(1000)) {
+        qCritical("mock: could not connect video socket to port %d", m_params.port);
+        return false;
+    }
+    m_controlSocket = new QTcpSocket(this);
+    m_controlSocket->connectToHost(QHostAddress::LocalHost, m_params.port);
+    if (!m_controlSocket->waitForConnected(1000)) {
+        qCritical("mock: could not connect control socket to port %d", m_params.port);
+        return false;
+    }
+    startStreaming();
+    return true;
+}
+
+void MockServer::onNewConnection()
+{
+    while (m_tcpServer.hasPendingConnections()) {
+        QTcpSocket *socket = m_tcpServer.nextPendingConnection();
+        if (!m_videoSocket) {
+            m_videoSocket = socket;
+            // the real server sends a dummy byte first on tunnel forward
+            m_videoSocket->write("\0", 1);
+        } else if (!m_controlSocket) {
+            m_controlSocket = socket;
+            m_tcpServer.close();
+            startStreaming();
+        } else {
+            socket->deleteLater();
+        }
+    }
+}
+
+void MockServer::startStreaming()
+{
+    connect(m_videoSocket, &QTcpSocket::disconnected, this, [this]() { stop(0); });
+    connect(m_controlSocket, &QTcpSocket::disconnected, this, [this]() { stop(0); });
+    connect(m_controlSocket, &QTcpSocket::readyRead, this, &MockServer::onControlReadyRead);
+
+    m_videoSocket->write(m_videoSource.deviceInfo());
+    m_streamTimer.start();
+    qInfo("mock: streaming %s", m_params.videoFile.toUtf8().data());
+    sendPackets();
+}
+
+void MockServer::sendPackets()
+{
+    qint64 now = m_streamTimer.nsecsElapsed() / 1000;
+    for (;;) {
+        if (m_nextPacket.isEmpty() && !m_videoSource.nextPacket(m_nextPacket, m_nextSendTime)) {
+            qInfo("mock: end of stream, %llu packets sent", m_sentPackets);
+            m_videoSocket->flush();
+            stop(0);
+            return;
+        }
+        if (m_nextSendTime > now) {
+            break;
+        }
+        m_videoSocket->write(m_nextPacket);
+        m_nextPacket.clear();
+        m_sentPackets++;
+    }
+
+    if (m_videoSocket->bytesToWrite() > 16 * 1024 * 1024) {
+        // the client does not keep up, do not buffer the whole clip in memory
+        m_videoSocket->waitForBytesWritten(100);
+    }
+    m_sendTimer.start(static_cast<int>((m_nextSendTime - now + 999) / 1000));
+}
+
+void MockServer::onControlReadyRead()
+{
+    m_controlBuffer.append(m_controlSocket->readAll());
+    for (;;) {
+        qint32 consume = consumeControlMsg(m_controlBuffer);
+        if (consume < 0) {
+            qCritical("mock: unknown control msg type %d", m_controlBuffer.isEmpty() ? -1 : m_controlBuffer[0]);
+            stop(1);
+            return;
+        }
+        if (!consume) {
+            break;
+        }
+        m_controlBuffer.remove(0, consume);
+        m_controlMsgs++;
+    }
+}
+
+qint32 MockServer::consumeControlMsg(const QByteArray &buffer)
+{
+    // returns the size of the first complete msg, 0 if not available
+    if (buffer.isEmpty()) {
+        return 0;
+    }
+    int type = buffer[0];
+    qint32 len = 0;
+    switch (type) {
+    case CMT_INJECT_KEYCODE:
+        len = 14;
+        if (buffer.size() >= len) {
+            qInfo("mock: inject keycode action=%d keycode=%u", buffer[1], bufferRead32be(buffer, 2));
+        }
+        break;
+    case CMT_INJECT_TEXT:
+        if (buffer.size() < 5) {
+            return 0;
+        }
+        len = 5 + static_cast<qint32>(bufferRead32be(buffer, 1));
+        if (buffer.size() >= len) {
+            qInfo("mock: inject text \"%s\"", buffer.mid(5, len - 5).constData());
+        }
+        break;
+    case CMT_INJECT_TOUCH:
+        len = 32;
+        if (buffer.size() >= len) {
+            qInfo("mock: inject touch action=%d x=%u y=%u", buffer[1], bufferRead32be(buffer, 10), bufferRead32be(buffer, 14));
+        }
+        break;
+    case CMT_INJECT_SCROLL:
+        len = 21;
+        if (buffer.size() >= len) {
+            qInfo("mock: inject scroll x=%u y=%u", bufferRead32be(buffer, 1), bufferRead32be(buffer, 5));
+        }
+        break;
+    case CMT_BACK_OR_SCREEN_ON:
+    case CMT_SET_DISPLAY_POWER:
+        len = 2;
+        if (buffer.size() >= len) {
+            qInfo("mock: control msg type=%d value=%d", type, buffer[1]);
+        }
+        break;
+    case CMT_GET_CLIPBOARD:
+        len = 2;
+        if (buffer.size() >= len) {
+            qInfo("mock: get clipboard");
+            sendClipboard(m_clipboard);
+        }
+        break;
+    case CMT_SET_CLIPBOARD:
+        if (buffer.size() < 14) {
+            return 0;
+        }
+        len = 14 + static_cast<qint32>(bufferRead32be(buffer, 10));
+        if (buffer.size() >= len) {
+            m_clipboard = buffer.mid(14, len - 14);
+            qInfo("mock: set clipboard \"%s\"", m_clipboard.constData());
+        }
+        break;
+    case CMT_EXPAND_NOTIFICATION_PANEL:
+    case CMT_EXPAND_SETTINGS_PANEL:
+    case CMT_COLLAPSE_PANELS:
+    case CMT_ROTATE_DEVICE:
+    case CMT_RESET_VIDEO:
+        len = 1;
+        qInfo("mock: control msg type=%d", type);
+        break;
+    default:
+        return -1;
+    }
+    return buffer.size() >= len ? len : 0;
+}
+
+void MockServer::sendClipboard(const QByteArray &text)
+{
+    QByteArray msg(5, '\0');
+    msg[0] = DMT_GET_CLIPBOARD;
+    bufferWrite32be(msg.data() + 1, static_cast<quint32>(text.size()));
+    msg.append(text);
+    m_controlSocket->write(msg);
+}
+
+void MockServer::stop(int exitCode)
+{
+    if (m_stopped) {
+        return;
+    }
+    m_stopped = true;
+    m_sendTimer.stop();
+    qInfo("mock: stop, %llu packets sent, %llu control msgs received", m_sentPackets, m_controlMsgs);
+    emit finished(exitCode);
+}
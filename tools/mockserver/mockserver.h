@@ -0,0 +1,64 @@
+#ifndef MOCKSERVER_H
+#define MOCKSERVER_H
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "videosource.h"
+
+// Stands in for the scrcpy server (app_process) on the video and control sockets
+class MockServer : public QObject
+{
+    Q_OBJECT
+public:
+    struct Params
+    {
+        QString videoFile = "";
+        QString deviceName = "mock";
+        QSize size = QSize(720, 1280);
+        quint32 fps = 60;
+        bool loop = true;
+        bool tunnelForward = false;
+        quint16 port = 27183;
+    };
+
+    explicit MockServer(const Params &params, QObject *parent = Q_NULLPTR);
+    virtual ~MockServer();
+
+    bool start();
+
+signals:
+    void finished(int exitCode);
+
+private:
+    void onNewConnection();
+    void startStreaming();
+    void sendPackets();
+    void onControlReadyRead();
+    qint32 consumeControlMsg(const QByteArray &buffer);
+    void sendClipboard(const QByteArray &text);
+    void stop(int exitCode);
+
+private:
+    Params m_params;
+    VideoSource m_videoSource;
+    QTcpServer m_tcpServer; // only used if tunnel forward
+    QPointer<QTcpSocket> m_videoSocket;
+    QPointer<QTcpSocket> m_controlSocket;
+    QByteArray m_controlBuffer;
+    QByteArray m_clipboard = "mock clipboard";
+
+    QTimer m_sendTimer;
+    QElapsedTimer m_streamTimer;
+    QByteArray m_nextPacket;
+    qint64 m_nextSendTime = -1;
+    quint64 m_sentPackets = 0;
+    quint64 m_controlMsgs = 0;
+    bool m_stopped = false;
+};
+
+#endif // MOCKSERVER_H
@@ -0,0 +1,234 @@
+#include <QDataStream>
+#include <QDebug>
+
+#include "videosource.h"
+
+// keep in sync with src/device/demuxer/streamcapture.h and demuxer.h
+#define STREAM_CAPTURE_MAGIC "QSCCAP01"
+#define STREAM_CAPTURE_MAGIC_SIZE 8
+#define DEVICE_NAME_FIELD_LENGTH 64
+#define CODEC_ID_H264 0x68323634 // "h264"
+
+#define SC_PACKET_FLAG_CONFIG (Q_UINT64_C(1) << 63)
+#define SC_PACKET_FLAG_KEY_FRAME (Q_UINT64_C(1) << 62)
+
+static void bufferWrite32be(char *buf, quint32 value)
+{
+    buf[0] = static_cast<char>(value >> 24);
+    buf[1] = static_cast<char>((value >> 16) & 0xff);
+    buf[2] = static_cast<char>((value >> 8) & 0xff);
+    buf[3] = static_cast<char>(value & 0xff);
+}
+
+static quint32 bufferRead32be(const char *buf)
+{
+    const quint8 *b = reinterpret_cast<const quint8 *>(buf);
+    return (static_cast<quint32>(b[0]) << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+VideoSource::VideoSource(const QString &fileName, const QString &deviceName, const QSize &size, quint32 fps, bool loop)
+    : m_fileName(fileName), m_deviceName(deviceName), m_size(size), m_fps(fps ? fps : 60), m_loop(loop), m_file(fileName)
+{}
+
+bool VideoSource::open()
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        qCritical("mock: could not open video file %s", m_fileName.toUtf8().data());
+        return false;
+    }
+    if (m_file.peek(STREAM_CAPTURE_MAGIC_SIZE) == QByteArray(STREAM_CAPTURE_MAGIC, STREAM_CAPTURE_MAGIC_SIZE)) {
+        m_capture = true;
+        return openCapture();
+    }
+    return openAnnexB();
+}
+
+QByteArray VideoSource::deviceInfo()
+{
+    return m_deviceInfo;
+}
+
+bool VideoSource::nextPacket(QByteArray &packet, qint64 &sendTime)
+{
+    if (m_capture) {
+        return nextCapturePacket(packet, sendTime);
+    }
+    return nextAnnexBPacket(packet, sendTime);
+}
+
+bool VideoSource::openCapture()
+{
+    m_file.seek(STREAM_CAPTURE_MAGIC_SIZE);
+    QDataStream stream(&m_file);
+    quint64 time = 0;
+    quint32 len = 0;
+    stream >> time >> len;
+    m_deviceInfo = m_file.read(len);
+    if (QDataStream::Ok != stream.status() || m_deviceInfo.size() != static_cast<int>(len)) {
+        qCritical("mock: truncated capture file %s", m_fileName.toUtf8().data());
+        return false;
+    }
+    m_captureDataPos = m_file.pos();
+    return true;
+}
+
+bool VideoSource::nextCapturePacket(QByteArray &packet, qint64 &sendTime)
+{
+    for (int i = 0; i < 2; i++) {
+        QDataStream stream(&m_file);
+        quint64 time = 0;
+        quint32 len = 0;
+        stream >> time >> len;
+        if (QDataStream::Ok == stream.status()) {
+            packet = m_file.read(len);
+            if (packet.size() == static_cast<int>(len)) {
+                m_lastTime = m_loopOffset + static_cast<qint64>(time);
+                sendTime = m_lastTime;
+                offsetCapturePts(packet);
+                return true;
+            }
+        }
+        if (!m_loop) {
+            break;
+        }
+        // the capture starts with the config packet and a key frame, play it again
+        m_file.seek(m_captureDataPos);
+        m_loopOffset = m_lastTime + 1000000 / m_fps;
+        // the device timestamps must keep increasing too
+        m_ptsLoopOffset = m_lastPts + 1000000 / m_fps - m_firstPts;
+    }
+    return false;
+}
+
+void VideoSource::offsetCapturePts(QByteArray &packet)
+{
+    if (packet.size() < 12) {
+        return;
+    }
+    quint64 ptsFlags = (static_cast<quint64>(bufferRead32be(packet.constData())) << 32) | bufferRead32be(packet.constData() + 4);
+    if (ptsFlags & SC_PACKET_FLAG_CONFIG) {
+        return;
+    }
+    qint64 pts = static_cast<qint64>(ptsFlags & ~(SC_PACKET_FLAG_CONFIG | SC_PACKET_FLAG_KEY_FRAME));
+    if (-1 == m_firstPts) {
+        m_firstPts = pts;
+    }
+    pts += m_ptsLoopOffset;
+    m_lastPts = pts;
+    ptsFlags = static_cast<quint64>(pts) | (ptsFlags & SC_PACKET_FLAG_KEY_FRAME);
+    bufferWrite32be(packet.data(), static_cast<quint32>(ptsFlags >> 32));
+    bufferWrite32be(packet.data() + 4, static_cast<quint32>(ptsFlags));
+}
+
+bool VideoSource::openAnnexB()
+{
+    QByteArray data = m_file.readAll();
+    m_file.close();
+
+    // split the stream into nal units
+    QVector<QByteArray> nals;
+    const char *p = data.constData();
+    int start = -1;
+    for (int i = 0; i + 3 <= data.size(); i++) {
+        if (p[i] || p[i + 1] || 1 != p[i + 2]) {
+            continue;
+        }
+        if (-1 != start) {
+            int end = i;
+            // 4 bytes start code
+            if (end > start && !p[end - 1]) {
+                end--;
+            }
+            nals.append(data.mid(start, end - start));
+        }
+        start = i + 3;
+        i += 2;
+    }
+    if (-1 != start && start < data.size()) {
+        nals.append(data.mid(start));
+    }
+
+    // group them into the packets the device encoder would output:
+    // sps/pps as a config packet, then one packet per frame
+    static const char startCode[] = { 0, 0, 0, 1 };
+    Frame config;
+    config.config = true;
+    QByteArray prefix;
+    Frame frame;
+    for (const QByteArray &nal : nals) {
+        if (nal.isEmpty()) {
+            continue;
+        }
+        int type = nal[0] & 0x1f;
+        if (7 == type || 8 == type) {
+            config.data.append(startCode, sizeof(startCode)).append(nal);
+            continue;
+        }
+        if (1 == type || 5 == type) {
+            // first_mb_in_slice == 0 starts a new frame
+            if (nal.size() > 1 && (nal[1] & 0x80) && !frame.data.isEmpty()) {
+                m_frames.append(frame);
+                frame = Frame();
+            }
+            if (!config.data.isEmpty()) {
+                m_frames.append(config);
+                config.data.clear();
+            }
+            frame.data.append(prefix);
+            prefix.clear();
+            frame.data.append(startCode, sizeof(startCode)).append(nal);
+            frame.keyFrame = frame.keyFrame || 5 == type;
+            continue;
+        }
+        // aud, sei...: sent with the next frame
+        prefix.append(startCode, sizeof(startCode)).append(nal);
+    }
+    if (!frame.data.isEmpty()) {
+        m_frames.append(frame);
+    }
+    if (m_frames.isEmpty() || !m_frames.first().config) {
+        qCritical("mock: %s is not an annex-b h264 stream starting with sps/pps", m_fileName.toUtf8().data());
+        return false;
+    }
+
+    m_deviceInfo = QByteArray(DEVICE_NAME_FIELD_LENGTH + 12, '\0');
+    QByteArray name = m_deviceName.toUtf8().left(DEVICE_NAME_FIELD_LENGTH - 1);
+    memcpy(m_deviceInfo.data(), name.constData(), static_cast<size_t>(name.size()));
+    bufferWrite32be(m_deviceInfo.data() + DEVICE_NAME_FIELD_LENGTH, CODEC_ID_H264);
+    bufferWrite32be(m_deviceInfo.data() + DEVICE_NAME_FIELD_LENGTH + 4, static_cast<quint32>(m_size.width()));
+    bufferWrite32be(m_deviceInfo.data() + DEVICE_NAME_FIELD_LENGTH + 8, static_cast<quint32>(m_size.height()));
+    return true;
+}
+
+bool VideoSource::nextAnnexBPacket(QByteArray &packet, qint64 &sendTime)
+{
+    if (m_nextFrame >= m_frames.size()) {
+        if (!m_loop) {
+            return false;
+        }
+        m_nextFrame = 0;
+    }
+    const Frame &frame = m_frames[m_nextFrame++];
+    qint64 pts = static_cast<qint64>(m_frameCount * 1000000 / m_fps);
+    quint64 ptsFlags = static_cast<quint64>(pts);
+    if (frame.config) {
+        ptsFlags = SC_PACKET_FLAG_CONFIG;
+    } else {
+        if (frame.keyFrame) {
+            ptsFlags |= SC_PACKET_FLAG_KEY_FRAME;
+        }
+        m_frameCount++;
+    }
+    packet = metaHeader(ptsFlags, frame.data.size()) + frame.data;
+    sendTime = pts;
+    return true;
+}
+
+QByteArray VideoSource::metaHeader(quint64 ptsFlags, qint32 len)
+{
+    QByteArray header(12, '\0');
+    bufferWrite32be(header.data(), static_cast<quint32>(ptsFlags >> 32));
+    bufferWrite32be(header.data() + 4, static_cast<quint32>(ptsFlags));
+    bufferWrite32be(header.data() + 8, static_cast<quint32>(len));
+    return header;
+}
@@ -0,0 +1,63 @@
+#ifndef VIDEOSOURCE_H
+#define VIDEOSOURCE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QSize>
+#include <QString>
+#include <QVector>
+
+// Packets to stream on the mock video socket, read from either
+// - a capture file written by DeviceParams::captureFile (replayed at the recorded pace)
+// - a raw annex-b h264 file (paced at a fixed fps)
+class VideoSource
+{
+public:
+    VideoSource(const QString &fileName, const QString &deviceName, const QSize &size, quint32 fps, bool loop);
+
+    bool open();
+    // device name, codec id and size, as read by Server::readInfo()
+    QByteArray deviceInfo();
+    // meta header plus packet, and its send time in us since the stream start
+    bool nextPacket(QByteArray &packet, qint64 &sendTime);
+
+private:
+    bool openCapture();
+    bool openAnnexB();
+    bool nextCapturePacket(QByteArray &packet, qint64 &sendTime);
+    bool nextAnnexBPacket(QByteArray &packet, qint64 &sendTime);
+    // adds the loop offset to the pts of the meta header
+    void offsetCapturePts(QByteArray &packet);
+    static QByteArray metaHeader(quint64 ptsFlags, qint32 len);
+
+private:
+    struct Frame
+    {
+        bool config = false;
+        bool keyFrame = false;
+        QByteArray data;
+    };
+
+    QString m_fileName;
+    QString m_deviceName;
+    QSize m_size;
+    quint32 m_fps = 60;
+    bool m_loop = false;
+
+    bool m_capture = false;
+    QByteArray m_deviceInfo;
+    QFile m_file;
+    qint64 m_captureDataPos = 0;
+    qint64 m_loopOffset = 0;
+    qint64 m_lastTime = 0;
+    // device timestamps of the capture
+    qint64 m_firstPts = -1;
+    qint64 m_lastPts = 0;
+    qint64 m_ptsLoopOffset = 0;
+
+    QVector<Frame> m_frames;
+    int m_nextFrame = 0;
+    quint64 m_frameCount = 0;
+};
+
+#endif // VIDEOSOURCE_H